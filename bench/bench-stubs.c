@@ -0,0 +1,482 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+// ========================================================================== //
+// libobs replacement for pipe-bench
+//
+// The benchmark compiles the plugin's ingest sources against the real libobs
+// headers but links this file instead of libobs: textures are plain memory,
+// so uploads cost what the map/copy costs, and every bmem allocation made
+// outside the publisher thread is counted.
+// ========================================================================== //
+
+#include "bench-stubs.h"
+
+#include <obs.h>
+#include <graphics/graphics.h>
+#include <media-io/video-io.h>
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "image-decoder.h"
+#include "plugin-support.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+const char *PLUGIN_NAME    = "obs-pipe-bench";
+const char *PLUGIN_VERSION = "bench";
+
+volatile long               bench_allocs    = 0;
+bool                        bench_verbose   = false;
+
+static _Thread_local bool   bench_untracked = false;
+
+void bench_set_untracked(bool untracked)
+{
+    bench_untracked = untracked;
+}
+
+void bench_count_alloc(void)
+{
+    if (!bench_untracked) {
+        __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// ========================================================================== //
+// util
+// ========================================================================== //
+void *bmalloc(size_t size)
+{
+    bench_count_alloc();
+    return malloc(size ? size : 1);
+}
+
+void *brealloc(void *ptr, size_t size)
+{
+    bench_count_alloc();
+    return realloc(ptr, size ? size : 1);
+}
+
+void bfree(void *ptr)
+{
+    free(ptr);
+}
+
+void blogva(int log_level, const char *format, va_list args)
+{
+    if (log_level > LOG_WARNING && !bench_verbose) {
+        return;
+    }
+
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+}
+
+void blog(int log_level, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    blogva(log_level, format, args);
+    va_end(args);
+}
+
+void obs_log(int log_level, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    blogva(log_level, format, args);
+    va_end(args);
+}
+
+uint64_t os_gettime_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int os_get_logical_cores(void)
+{
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+void os_set_thread_name(const char *name)
+{
+    UNUSED_PARAMETER(name);
+}
+
+struct os_sem_data {
+    pthread_mutex_t             mutex;
+    pthread_cond_t              cond;
+    int                         value;
+};
+
+int os_sem_init(os_sem_t **sem, int value)
+{
+    os_sem_t *data = bzalloc(sizeof(os_sem_t));
+    pthread_mutex_init(&data->mutex, NULL);
+    pthread_cond_init(&data->cond, NULL);
+    data->value = value;
+    *sem = data;
+    return 0;
+}
+
+void os_sem_destroy(os_sem_t *sem)
+{
+    if (sem) {
+        pthread_cond_destroy(&sem->cond);
+        pthread_mutex_destroy(&sem->mutex);
+        bfree(sem);
+    }
+}
+
+int os_sem_post(os_sem_t *sem)
+{
+    pthread_mutex_lock(&sem->mutex);
+    sem->value++;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->mutex);
+    return 0;
+}
+
+int os_sem_wait(os_sem_t *sem)
+{
+    pthread_mutex_lock(&sem->mutex);
+    while (sem->value == 0) {
+        pthread_cond_wait(&sem->cond, &sem->mutex);
+    }
+    sem->value--;
+    pthread_mutex_unlock(&sem->mutex);
+    return 0;
+}
+
+// ========================================================================== //
+// obs
+// ========================================================================== //
+void obs_enter_graphics(void) {}
+void obs_leave_graphics(void) {}
+
+float obs_get_video_sdr_white_level(void)
+{
+    return 300.0f;
+}
+
+gs_effect_t *obs_get_base_effect(enum obs_base_effect effect)
+{
+    UNUSED_PARAMETER(effect);
+    return NULL;
+}
+
+void obs_source_output_video(obs_source_t *source, const struct obs_source_frame *frame)
+{
+    UNUSED_PARAMETER(source);
+    UNUSED_PARAMETER(frame);
+}
+
+void obs_source_output_audio(obs_source_t *source, const struct obs_source_audio *audio)
+{
+    UNUSED_PARAMETER(source);
+    UNUSED_PARAMETER(audio);
+}
+
+bool video_format_get_parameters_for_format(
+    enum video_colorspace       color_space,
+    enum video_range_type       range,
+    enum video_format           format,
+    float                       matrix[16],
+    float                       min_range[3],
+    float                       max_range[3]
+) {
+    UNUSED_PARAMETER(color_space);
+    UNUSED_PARAMETER(range);
+    UNUSED_PARAMETER(format);
+
+    memset(matrix, 0, sizeof(float) * 16);
+    for (size_t i = 0; i < 3; i++) {
+        min_range[i] = 0.0f;
+        max_range[i] = 1.0f;
+    }
+    return true;
+}
+
+// ========================================================================== //
+// graphics
+// ========================================================================== //
+struct gs_texture {
+    uint32_t                    width;
+    uint32_t                    height;
+    uint32_t                    linesize;
+    enum gs_color_format        format;
+    uint8_t                     *data;
+};
+
+struct gs_texture_render {
+    gs_texture_t                *target;
+};
+
+gs_texture_t *gs_texture_create(
+    uint32_t                    width,
+    uint32_t                    height,
+    enum gs_color_format        color_format,
+    uint32_t                    levels,
+    const uint8_t               **data,
+    uint32_t                    flags
+) {
+    UNUSED_PARAMETER(levels);
+    UNUSED_PARAMETER(flags);
+
+    gs_texture_t *texture = bzalloc(sizeof(gs_texture_t));
+    texture->width    = width;
+    texture->height   = height;
+    texture->linesize = width * gs_get_format_bpp(color_format) / 8;
+    texture->format   = color_format;
+    texture->data     = bmalloc((size_t)texture->linesize * height);
+
+    if (data && data[0]) {
+        memcpy(texture->data, data[0], (size_t)texture->linesize * height);
+    }
+    return texture;
+}
+
+void gs_texture_destroy(gs_texture_t *tex)
+{
+    if (tex) {
+        bfree(tex->data);
+        bfree(tex);
+    }
+}
+
+uint32_t gs_texture_get_width(const gs_texture_t *tex)
+{
+    return tex->width;
+}
+
+uint32_t gs_texture_get_height(const gs_texture_t *tex)
+{
+    return tex->height;
+}
+
+enum gs_color_format gs_texture_get_color_format(const gs_texture_t *tex)
+{
+    return tex->format;
+}
+
+bool gs_texture_map(gs_texture_t *tex, uint8_t **ptr, uint32_t *linesize)
+{
+    *ptr      = tex->data;
+    *linesize = tex->linesize;
+    return true;
+}
+
+void gs_texture_unmap(gs_texture_t *tex)
+{
+    UNUSED_PARAMETER(tex);
+}
+
+void gs_texture_set_image(gs_texture_t *tex, const uint8_t *data, uint32_t linesize, bool invert)
+{
+    UNUSED_PARAMETER(invert);
+
+    const uint32_t row = linesize < tex->linesize ? linesize : tex->linesize;
+    for (uint32_t y = 0; y < tex->height; y++) {
+        memcpy(tex->data + (size_t)y * tex->linesize, data + (size_t)y * linesize, row);
+    }
+}
+
+gs_texrender_t *gs_texrender_create(enum gs_color_format format, enum gs_zstencil_format zsformat)
+{
+    UNUSED_PARAMETER(zsformat);
+
+    gs_texrender_t *texrender = bzalloc(sizeof(gs_texrender_t));
+    texrender->target = gs_texture_create(1, 1, format, 1, NULL, 0);
+    return texrender;
+}
+
+void gs_texrender_destroy(gs_texrender_t *texrender)
+{
+    if (texrender) {
+        gs_texture_destroy(texrender->target);
+        bfree(texrender);
+    }
+}
+
+bool gs_texrender_begin(gs_texrender_t *texrender, uint32_t cx, uint32_t cy)
+{
+    UNUSED_PARAMETER(texrender);
+    UNUSED_PARAMETER(cx);
+    UNUSED_PARAMETER(cy);
+    return true;
+}
+
+void gs_texrender_end(gs_texrender_t *texrender)
+{
+    UNUSED_PARAMETER(texrender);
+}
+
+void gs_texrender_reset(gs_texrender_t *texrender)
+{
+    UNUSED_PARAMETER(texrender);
+}
+
+gs_texture_t *gs_texrender_get_texture(const gs_texrender_t *texrender)
+{
+    return texrender ? texrender->target : NULL;
+}
+
+gs_eparam_t *gs_effect_get_param_by_name(const gs_effect_t *effect, const char *name)
+{
+    UNUSED_PARAMETER(effect);
+    UNUSED_PARAMETER(name);
+    return NULL;
+}
+
+bool gs_effect_loop(gs_effect_t *effect, const char *name)
+{
+    UNUSED_PARAMETER(effect);
+    UNUSED_PARAMETER(name);
+    return false;
+}
+
+void gs_effect_set_texture(gs_eparam_t *param, gs_texture_t *val)
+{
+    UNUSED_PARAMETER(param);
+    UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_texture_srgb(gs_eparam_t *param, gs_texture_t *val)
+{
+    UNUSED_PARAMETER(param);
+    UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_float(gs_eparam_t *param, float val)
+{
+    UNUSED_PARAMETER(param);
+    UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_vec2(gs_eparam_t *param, const struct vec2 *val)
+{
+    UNUSED_PARAMETER(param);
+    UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_vec4(gs_eparam_t *param, const struct vec4 *val)
+{
+    UNUSED_PARAMETER(param);
+    UNUSED_PARAMETER(val);
+}
+
+void gs_effect_set_val(gs_eparam_t *param, const void *val, size_t size)
+{
+    UNUSED_PARAMETER(param);
+    UNUSED_PARAMETER(val);
+    UNUSED_PARAMETER(size);
+}
+
+void gs_draw_sprite(gs_texture_t *tex, uint32_t flip, uint32_t width, uint32_t height)
+{
+    UNUSED_PARAMETER(tex);
+    UNUSED_PARAMETER(flip);
+    UNUSED_PARAMETER(width);
+    UNUSED_PARAMETER(height);
+}
+
+void gs_draw_sprite_subregion(gs_texture_t *tex, uint32_t flip, uint32_t x, uint32_t y, uint32_t cx, uint32_t cy)
+{
+    UNUSED_PARAMETER(tex);
+    UNUSED_PARAMETER(flip);
+    UNUSED_PARAMETER(x);
+    UNUSED_PARAMETER(y);
+    UNUSED_PARAMETER(cx);
+    UNUSED_PARAMETER(cy);
+}
+
+void gs_ortho(float left, float right, float top, float bottom, float znear, float zfar)
+{
+    UNUSED_PARAMETER(left);
+    UNUSED_PARAMETER(right);
+    UNUSED_PARAMETER(top);
+    UNUSED_PARAMETER(bottom);
+    UNUSED_PARAMETER(znear);
+    UNUSED_PARAMETER(zfar);
+}
+
+void gs_blend_state_push(void) {}
+void gs_blend_state_pop(void) {}
+void gs_enable_blending(bool enable) { UNUSED_PARAMETER(enable); }
+bool gs_framebuffer_srgb_enabled(void) { return false; }
+void gs_enable_framebuffer_srgb(bool enable) { UNUSED_PARAMETER(enable); }
+void gs_matrix_push(void) {}
+void gs_matrix_pop(void) {}
+void gs_matrix_translate3f(float x, float y, float z)
+{
+    UNUSED_PARAMETER(x);
+    UNUSED_PARAMETER(y);
+    UNUSED_PARAMETER(z);
+}
+
+// ========================================================================== //
+// graphics-custom
+// ========================================================================== //
+gs_effect_t *gs_custom_get_convert_effect(void)
+{
+    return NULL;
+}
+
+uint8_t *gs_get_pixel_data_from_buffer(
+    const uint8_t               *buffer,
+    size_t                      length,
+    enum gs_color_format        *color_format,
+    uint32_t                    *cx,
+    uint32_t                    *cy,
+    enum gs_color_space         *color_space,
+    uint8_t                     **pixel_data,
+    size_t                      *pixel_data_length
+) {
+    UNUSED_PARAMETER(buffer);
+    UNUSED_PARAMETER(length);
+    UNUSED_PARAMETER(color_format);
+    UNUSED_PARAMETER(cx);
+    UNUSED_PARAMETER(cy);
+    UNUSED_PARAMETER(color_space);
+    UNUSED_PARAMETER(pixel_data);
+    UNUSED_PARAMETER(pixel_data_length);
+    return NULL;
+}
+
+static bool magick_probe(const uint8_t *data, size_t size)
+{
+    UNUSED_PARAMETER(data);
+    UNUSED_PARAMETER(size);
+    return false;
+}
+
+const struct image_decoder_backend image_decoder_magick = {
+    .name   = "magick",
+    .probe  = magick_probe,
+};
@@ -0,0 +1,37 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Allocations (bmem and operator new) made by threads that did not set
+// `bench_untracked`. Pixel pool misses are counted by the pool itself.
+extern volatile long bench_allocs;
+extern bool bench_verbose;
+
+void bench_count_alloc(void);
+void bench_set_untracked(bool untracked);
+
+#ifdef __cplusplus
+}
+#endif
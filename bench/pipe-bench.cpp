@@ -0,0 +1,495 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+// ========================================================================== //
+// pipe-bench
+//
+// Publishes synthetic frames on a local eCAL topic and consumes them the way
+// pipe_source_load does: frame_manager_receive, then
+// gs_image_buffer_init_from_raw_pixels and gs_image_buffer_init_texture
+// against the stub graphics layer, on a simulated video thread.
+//
+//   pipe-bench [--width N] [--height N] [--stride N] [--fps N] [--tick-fps N]
+//              [--seconds N] [--transport protobuf|raw] [--mode callback|poll]
+//              [--codec none|stripes] [--keyframes N] [--network] [--verbose]
+//
+// --stride pads the rows of raw frames to N bytes, like GPU readbacks do.
+// --codec stripes sends raw frames as QOI_STRIPES. --keyframes N sends raw
+// frames as deltas against a keyframe repeated every N frames. --network
+// forces eCAL's
+// UDP multicast layer with loopback, so a single host sees what a pipe
+// across the network costs.
+// ========================================================================== //
+
+#include <ecal/ecal.h>
+#include <ecal/msg/protobuf/publisher.h>
+
+#include <obs.h>
+#include <util/platform.h>
+
+#include "bench-stubs.h"
+#include "decode-pool.h"
+#include "frame-manager.h"
+#include "image-buffer.h"
+#include "pipe-frame.h"
+#include "pixel-convert.h"
+#include "pixel-pool.h"
+#include "stripe-codec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BENCH_PIPE_NAME     "obs-pipe-bench"
+#define BENCH_SEND_RING     4096
+#define BENCH_WARMUP_FRAMES 30
+
+// ========================================================================== //
+// Allocation counting
+// ========================================================================== //
+void *operator new(size_t size)
+{
+    bench_count_alloc();
+    if (void *ptr = malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+// ========================================================================== //
+// Options
+// ========================================================================== //
+struct bench_options_t {
+    uint32_t                width       = 1920;
+    uint32_t                height      = 1080;
+    uint32_t                stride      = 0;        // Raw only, 0 = width * 4.
+    uint32_t                fps         = 60;
+    uint32_t                tick_fps    = 60;
+    uint32_t                seconds     = 10;
+    enum frame_transport    transport   = FRAME_TRANSPORT_RAW;
+    enum frame_receive_mode mode        = FRAME_RECEIVE_CALLBACK;
+    bool                    stripes     = false;    // Raw only.
+    uint32_t                keyframes   = 0;        // Raw only, 0 = no deltas.
+    bool                    network     = false;
+};
+
+static bool bench_parse_options(int argc, char **argv, bench_options_t *options)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *arg   = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (strcmp(arg, "--verbose") == 0) {
+            bench_verbose = true;
+            continue;
+        }
+        if (strcmp(arg, "--network") == 0) {
+            options->network = true;
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        i++;
+
+        if (strcmp(arg, "--width") == 0) {
+            options->width = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--height") == 0) {
+            options->height = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--stride") == 0) {
+            options->stride = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--fps") == 0) {
+            options->fps = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--tick-fps") == 0) {
+            options->tick_fps = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--seconds") == 0) {
+            options->seconds = (uint32_t)atoi(value);
+        } else if (strcmp(arg, "--transport") == 0) {
+            options->transport = strcmp(value, "protobuf") == 0 ? FRAME_TRANSPORT_PROTOBUF : FRAME_TRANSPORT_RAW;
+        } else if (strcmp(arg, "--mode") == 0) {
+            options->mode = strcmp(value, "poll") == 0 ? FRAME_RECEIVE_POLL : FRAME_RECEIVE_CALLBACK;
+        } else if (strcmp(arg, "--codec") == 0) {
+            options->stripes = strcmp(value, "stripes") == 0;
+        } else if (strcmp(arg, "--keyframes") == 0) {
+            options->keyframes = (uint32_t)atoi(value);
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+
+    if (options->width == 0 || options->height == 0 || options->fps == 0 || options->tick_fps == 0) {
+        fprintf(stderr, "width, height and rates must be positive\n");
+        return false;
+    }
+    if (options->stride != 0 && options->stride < options->width * 4) {
+        fprintf(stderr, "stride must be at least width * 4\n");
+        return false;
+    }
+    if (options->stride != 0 && options->transport != FRAME_TRANSPORT_RAW) {
+        fprintf(stderr, "stride needs the raw transport\n");
+        return false;
+    }
+    if (options->stripes && options->transport != FRAME_TRANSPORT_RAW) {
+        fprintf(stderr, "the stripe codec needs the raw transport\n");
+        return false;
+    }
+    if (options->keyframes != 0 && options->transport != FRAME_TRANSPORT_RAW) {
+        fprintf(stderr, "delta frames need the raw transport\n");
+        return false;
+    }
+    return true;
+}
+
+// ========================================================================== //
+// Publisher
+// ========================================================================== //
+struct bench_publisher_t {
+    const bench_options_t   *options;
+    std::atomic<bool>       running;
+    std::atomic<int64_t>    published;
+    std::atomic<uint64_t>   sent_bytes;
+    std::atomic<uint64_t>   send_times[BENCH_SEND_RING];
+};
+
+// Waits for the subscriber to be matched so the first frames are not lost
+// to eCAL registration.
+template <typename T>
+static bool bench_wait_subscribed(const T &publisher)
+{
+    for (int i = 0; i < 50; i++) {
+        if (publisher.IsSubscribed()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return false;
+}
+
+// Smooth gradients, so the stripe codec sees something closer to a real
+// frame than a blank one.
+static void bench_init_pixels(std::string &pixels, uint32_t width, uint32_t stride)
+{
+    for (size_t offset = 0; offset < pixels.size(); offset++) {
+        const size_t x = offset % stride / 4;
+        const size_t y = offset / stride;
+        pixels[offset] = offset % 4 == 3 ? (char)255 : (char)(x * 255 / width + y / 4 + offset % 4 * 40);
+    }
+}
+
+static void bench_fill_pixels(std::string &pixels, int64_t id)
+{
+    // Touch every line so nothing downstream can get away with stale data.
+    const size_t stride = pixels.size() / 64;
+    for (size_t offset = 0; offset < pixels.size(); offset += stride) {
+        pixels[offset] = (char)(id + offset);
+    }
+}
+
+static void bench_publish(bench_publisher_t *publisher)
+{
+    const bench_options_t   *options = publisher->options;
+    const uint32_t          stride   = options->stride ? options->stride : options->width * 4;
+    const size_t            size     = (size_t)stride * options->height;
+
+    bench_set_untracked(true);
+
+    eCAL::protobuf::CPublisher<ObsPipe::Proto::Frame>   proto_publisher;
+    eCAL::CPublisher                                    raw_publisher;
+    ObsPipe::Proto::Frame                               frame;
+    std::string                                         buffer;
+    std::string                                         pixels(size, '\0');
+    std::string                                         key;
+    std::string                                         delta(options->keyframes ? size : 0, '\0');
+    int64_t                                             key_id = 0;
+
+    bench_init_pixels(pixels, options->width, stride);
+
+    const size_t payload_capacity = options->stripes
+        ? stripe_codec_bound(options->width, options->height, STRIPE_CODEC_STRIPES)
+        : size;
+
+    const bool raw = options->transport == FRAME_TRANSPORT_RAW;
+    if (raw) {
+        raw_publisher.Create(BENCH_PIPE_NAME);
+        buffer.resize(sizeof(obs_pipe_raw_header_t) + payload_capacity);
+    } else {
+        proto_publisher.Create(BENCH_PIPE_NAME);
+    }
+
+    if (options->network) {
+        if (raw) {
+            raw_publisher.SetLayerMode(eCAL::TLayer::tlayer_all, eCAL::TLayer::smode_off);
+            raw_publisher.SetLayerMode(eCAL::TLayer::tlayer_udp_mc, eCAL::TLayer::smode_on);
+        } else {
+            proto_publisher.SetLayerMode(eCAL::TLayer::tlayer_all, eCAL::TLayer::smode_off);
+            proto_publisher.SetLayerMode(eCAL::TLayer::tlayer_udp_mc, eCAL::TLayer::smode_on);
+        }
+    }
+
+    const bool subscribed = raw
+        ? bench_wait_subscribed(raw_publisher)
+        : bench_wait_subscribed(proto_publisher);
+    if (!subscribed) {
+        fprintf(stderr, "no subscriber matched, publishing anyway\n");
+    }
+
+    const auto  interval = std::chrono::nanoseconds(1000000000ULL / options->fps);
+    auto        next     = std::chrono::steady_clock::now();
+
+    for (int64_t id = 0; publisher->running; id++) {
+        bench_fill_pixels(pixels, id);
+        publisher->send_times[id % BENCH_SEND_RING] = os_gettime_ns();
+
+        if (raw) {
+            obs_pipe_raw_header_t header = {};
+            header.magic       = OBS_PIPE_RAW_MAGIC;
+            header.version     = OBS_PIPE_RAW_VERSION;
+            header.header_size = sizeof(header);
+            header.id          = id;
+            header.width       = options->width;
+            header.height      = options->height;
+            header.format      = OBS_PIPE_FORMAT_BGRA;
+            header.stride      = stride;
+
+            const uint8_t *frame_pixels = (const uint8_t *)pixels.data();
+            if (options->keyframes && id % options->keyframes == 0) {
+                header.flags |= OBS_PIPE_FLAG_KEYFRAME;
+                key.assign(pixels);
+                key_id = id;
+            } else if (options->keyframes) {
+                header.flags  |= OBS_PIPE_FLAG_DELTA;
+                header.base_id = key_id;
+                pixel_convert_xor((uint8_t *)&delta[0], frame_pixels, (const uint8_t *)key.data(), size);
+                frame_pixels = (const uint8_t *)delta.data();
+            }
+
+            size_t payload = size;
+            if (options->stripes) {
+                header.format = OBS_PIPE_FORMAT_QOI_STRIPES;
+                header.stride = 0;
+                payload       = stripe_codec_encode(
+                    (uint8_t *)&buffer[sizeof(header)],
+                    frame_pixels,
+                    options->width,
+                    options->height,
+                    stride,
+                    STRIPE_CODEC_STRIPES
+                );
+            } else {
+                memcpy(&buffer[sizeof(header)], frame_pixels, size);
+            }
+
+            memcpy(&buffer[0], &header, sizeof(header));
+            raw_publisher.Send(buffer.data(), sizeof(header) + payload);
+            publisher->sent_bytes += sizeof(header) + payload;
+        } else {
+            frame.set_id(id);
+            frame.set_width(options->width);
+            frame.set_height(options->height);
+            frame.set_buffer(pixels);
+            proto_publisher.Send(frame);
+            publisher->sent_bytes += size;
+        }
+
+        publisher->published = id + 1;
+
+        next += interval;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+// ========================================================================== //
+// Report
+// ========================================================================== //
+static double bench_percentile(std::vector<uint64_t> &values, double percentile)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+
+    const size_t index = std::min(values.size() - 1, (size_t)(values.size() * percentile / 100.0));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index] / 1000000.0;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options;
+    if (!bench_parse_options(argc, argv, &options)) {
+        return 1;
+    }
+
+    if (eCAL::Initialize(0, nullptr, "obs-pipe-bench") < 0) {
+        fprintf(stderr, "failed to initialize eCAL\n");
+        return 1;
+    }
+    eCAL::Util::EnableLoopback(true);
+
+    if (!decode_pool_init()) {
+        fprintf(stderr, "failed to start the decode pool\n");
+        eCAL::Finalize();
+        return 1;
+    }
+
+    frame_manager_t *manager = new frame_manager_t();
+    gs_image_buffer_t image = {};
+
+    frame_manager_config_t config = {};
+    config.pipe_name = BENCH_PIPE_NAME;
+    config.mode      = options.mode;
+    config.transport = options.transport;
+    frame_manager_open(manager, &config);
+
+    bench_publisher_t *publisher = new bench_publisher_t();
+    publisher->options    = &options;
+    publisher->running    = true;
+    publisher->published  = 0;
+    publisher->sent_bytes = 0;
+    std::thread publish_thread(bench_publish, publisher);
+
+    std::vector<uint64_t>   latencies;
+    std::vector<uint64_t>   uploads;
+    uint64_t                bytes       = 0;
+    uint64_t                frames      = 0;
+    uint64_t                skipped     = 0;
+    int64_t                 last_id     = -1;
+    long                    allocs_base = 0;
+    uint64_t                start       = 0;
+
+    latencies.reserve((size_t)options.fps * options.seconds);
+    uploads.reserve((size_t)options.fps * options.seconds);
+
+    const auto  tick     = std::chrono::nanoseconds(1000000000ULL / options.tick_fps);
+    auto        next     = std::chrono::steady_clock::now();
+    uint64_t    deadline = 0;
+
+    for (;;) {
+        const frame_slot_t *frame = frame_manager_receive(manager);
+
+        if (frame) {
+            const uint64_t upload_start = os_gettime_ns();
+            gs_image_buffer_init_from_raw_pixels(
+                &image,
+                frame->data,
+                frame->size,
+                frame->width,
+                frame->height,
+                frame->linesize[0],
+                frame->format,
+                GS_IMAGE_ALPHA_STRAIGHT,
+                GS_CS_SRGB
+            );
+            gs_image_buffer_init_texture(&image);
+            const uint64_t upload_end = os_gettime_ns();
+
+            if (frame->id >= BENCH_WARMUP_FRAMES) {
+                if (start == 0) {
+                    start       = upload_end;
+                    deadline    = start + (uint64_t)options.seconds * 1000000000ULL;
+                    allocs_base = bench_allocs + pixel_pool_misses();
+                } else {
+                    if (frame->id > last_id + 1) {
+                        skipped += (uint64_t)(frame->id - last_id - 1);
+                    }
+                    frames++;
+                    bytes += frame->size;
+                    uploads.push_back(upload_end - upload_start);
+                    latencies.push_back(upload_end - publisher->send_times[frame->id % BENCH_SEND_RING]);
+                }
+            }
+            last_id = frame->id;
+        }
+
+        if (deadline && os_gettime_ns() >= deadline) {
+            break;
+        }
+
+        next += tick;
+        std::this_thread::sleep_until(next);
+    }
+
+    const uint64_t  elapsed = os_gettime_ns() - start;
+    const long      allocs  = bench_allocs + pixel_pool_misses() - allocs_base;
+
+    publisher->running = false;
+    publish_thread.join();
+
+    frame_manager_close(manager);
+    gs_image_buffer_free(&image);
+
+    const double seconds = elapsed / 1000000000.0;
+
+    printf("transport:          %s\n", options.transport == FRAME_TRANSPORT_RAW ? "raw" : "protobuf");
+    printf("receive mode:       %s\n", options.mode == FRAME_RECEIVE_POLL ? "poll" : "callback");
+    printf("resolution:         %ux%u @ %u fps (tick %u fps)\n", options.width, options.height, options.fps, options.tick_fps);
+    if (options.stride) {
+        printf("stride:             %u bytes\n", options.stride);
+    }
+    printf("codec:              %s\n", options.stripes ? "stripes" : "none");
+    if (options.keyframes) {
+        printf("keyframe interval:  %u frames\n", options.keyframes);
+    }
+    printf("eCAL layer:         %s\n", options.network ? "udp multicast (loopback)" : "default");
+    printf("frames published:   %lld\n", (long long)publisher->published.load());
+    printf("bytes per message:  %.0f\n", publisher->published > 0 ? publisher->sent_bytes / (double)publisher->published : 0.0);
+    printf("frames uploaded:    %llu (%llu skipped)\n", (unsigned long long)frames, (unsigned long long)skipped);
+    printf("throughput:         %.1f fps, %.1f MB/s\n", frames / seconds, bytes / seconds / 1000000.0);
+    printf("latency p50/p99:    %.3f / %.3f ms\n", bench_percentile(latencies, 50.0), bench_percentile(latencies, 99.0));
+    printf("upload p50/p99:     %.3f / %.3f ms\n", bench_percentile(uploads, 50.0), bench_percentile(uploads, 99.0));
+    printf("allocations/frame:  %.2f\n", frames > 0 ? allocs / (double)frames : 0.0);
+
+    delete publisher;
+    delete manager;
+    decode_pool_free();
+    eCAL::Finalize();
+    return 0;
+}
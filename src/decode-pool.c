@@ -0,0 +1,223 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "decode-pool.h"
+#include "plugin-support.h"
+
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define DECODE_POOL_MAX_THREADS 4
+
+struct decode_pool_job {
+    decode_pool_task_t          task;
+    void                        *param;
+};
+
+struct decode_pool {
+    pthread_t                   threads[DECODE_POOL_MAX_THREADS];
+    size_t                      thread_count;
+
+    pthread_mutex_t             mutex;
+    os_sem_t                    *sem;
+    struct circlebuf            jobs;
+};
+
+// One decode_pool_run call. Heap allocated and shared by the caller and its
+// helpers, the last one to let go frees it: a helper that only gets to run
+// after the caller returned still has to see the drained counter.
+struct decode_pool_range {
+    decode_pool_range_t         task;
+    void                        *param;
+    long                        count;
+    volatile long               next;
+    volatile long               finished;
+    volatile long               refs;
+    os_event_t                  *done;
+};
+
+static struct decode_pool pool;
+
+static void *decode_pool_thread(void *data)
+{
+    UNUSED_PARAMETER(data);
+
+    os_set_thread_name("obs-pipe-source: decode");
+
+    for (;;) {
+        struct decode_pool_job job = {0};
+
+        if (os_sem_wait(pool.sem) != 0) {
+            break;
+        }
+
+        pthread_mutex_lock(&pool.mutex);
+        if (pool.jobs.size >= sizeof(job)) {
+            circlebuf_pop_front(&pool.jobs, &job, sizeof(job));
+        }
+        pthread_mutex_unlock(&pool.mutex);
+
+        // A post without a job is the stop request.
+        if (!job.task) {
+            break;
+        }
+
+        job.task(job.param);
+    }
+
+    return NULL;
+}
+
+bool decode_pool_init(void)
+{
+    int cores = os_get_logical_cores() / 2;
+
+    memset(&pool, 0, sizeof(pool));
+
+    if (pthread_mutex_init(&pool.mutex, NULL) != 0) {
+        return false;
+    }
+    if (os_sem_init(&pool.sem, 0) != 0) {
+        pthread_mutex_destroy(&pool.mutex);
+        return false;
+    }
+
+    circlebuf_init(&pool.jobs);
+
+    pool.thread_count = cores < 1 ? 1
+                      : cores > DECODE_POOL_MAX_THREADS ? DECODE_POOL_MAX_THREADS
+                      : (size_t)cores;
+
+    for (size_t i = 0; i < pool.thread_count; i++) {
+        if (pthread_create(&pool.threads[i], NULL, decode_pool_thread, NULL) != 0) {
+            obs_log(LOG_ERROR, "failed to create decode thread");
+            pool.thread_count = i;
+            break;
+        }
+    }
+
+    obs_log(LOG_INFO, "decode pool started with %zu threads", pool.thread_count);
+    return pool.thread_count > 0;
+}
+
+void decode_pool_free(void)
+{
+    if (!pool.sem) {
+        return;
+    }
+
+    // Jobs still queued run first, stop posts come after them.
+    for (size_t i = 0; i < pool.thread_count; i++) {
+        os_sem_post(pool.sem);
+    }
+    for (size_t i = 0; i < pool.thread_count; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+
+    circlebuf_free(&pool.jobs);
+    os_sem_destroy(pool.sem);
+    pthread_mutex_destroy(&pool.mutex);
+
+    memset(&pool, 0, sizeof(pool));
+}
+
+void decode_pool_push(decode_pool_task_t task, void *param)
+{
+    struct decode_pool_job job = {task, param};
+
+    pthread_mutex_lock(&pool.mutex);
+    circlebuf_push_back(&pool.jobs, &job, sizeof(job));
+    pthread_mutex_unlock(&pool.mutex);
+
+    os_sem_post(pool.sem);
+}
+
+static void decode_pool_range_release(struct decode_pool_range *range)
+{
+    if (os_atomic_dec_long(&range->refs) == 0) {
+        if (range->done) {
+            os_event_destroy(range->done);
+        }
+        bfree(range);
+    }
+}
+
+static void decode_pool_range_claim(struct decode_pool_range *range)
+{
+    for (;;) {
+        const long index = os_atomic_inc_long(&range->next) - 1;
+        if (index >= range->count) {
+            break;
+        }
+
+        range->task(range->param, (size_t)index);
+
+        if (os_atomic_inc_long(&range->finished) == range->count && range->done) {
+            os_event_signal(range->done);
+        }
+    }
+}
+
+static void decode_pool_range_helper(void *param)
+{
+    struct decode_pool_range *range = param;
+
+    decode_pool_range_claim(range);
+    decode_pool_range_release(range);
+}
+
+void decode_pool_run(decode_pool_range_t task, void *param, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    const size_t helpers = count - 1 < pool.thread_count ? count - 1 : pool.thread_count;
+
+    struct decode_pool_range *range = bzalloc(sizeof(*range));
+    range->task  = task;
+    range->param = param;
+    range->count = (long)count;
+    range->refs  = 1;
+
+    // Without an event the caller just does all of it.
+    if (helpers > 0 && os_event_init(&range->done, OS_EVENT_TYPE_MANUAL) == 0) {
+        range->refs += (long)helpers;
+        for (size_t i = 0; i < helpers; i++) {
+            decode_pool_push(decode_pool_range_helper, range);
+        }
+    }
+
+    decode_pool_range_claim(range);
+
+    // Only stripes a helper claimed can still be running. Helpers that are
+    // queued behind other jobs find nothing left and just drop their ref.
+    if (os_atomic_load_long(&range->finished) < range->count) {
+        os_event_wait(range->done);
+    }
+
+    decode_pool_range_release(range);
+}
+
+size_t decode_pool_thread_count(void)
+{
+    return pool.thread_count;
+}
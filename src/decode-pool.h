@@ -0,0 +1,54 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================================================== //
+// Decode pool
+//
+// Small module-wide pool of worker threads for CPU heavy per-frame work
+// (image decoding), so it never runs on the video or eCAL receive threads.
+// ========================================================================== //
+
+typedef void (*decode_pool_task_t)(void *param);
+typedef void (*decode_pool_range_t)(void *param, size_t index);
+
+bool decode_pool_init(void);
+void decode_pool_free(void);
+
+// Queues `task`, it runs on one of the pool threads.
+void decode_pool_push(decode_pool_task_t task, void *param);
+
+// Runs `task` once for every index below `count`, spread over the pool
+// threads and the calling thread, and returns when all of them are done.
+// The caller picks up indices itself and only waits for the ones a pool
+// thread started, not for helpers still queued behind other jobs. Must not be
+// called from a pool task.
+void decode_pool_run(decode_pool_range_t task, void *param, size_t count);
+
+size_t decode_pool_thread_count(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,234 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "frame-mailbox.h"
+#include "pixel-pool.h"
+
+#include <util/bmem.h>
+#include <util/threading.h>
+
+#define FRAME_MAILBOX_FRESH     0x4
+#define FRAME_MAILBOX_INDEX     0x3
+
+void frame_mailbox_init(frame_mailbox_t *mailbox)
+{
+    memset(mailbox, 0, sizeof(*mailbox));
+
+    mailbox->write_index = 0;
+    mailbox->read_index  = 1;
+    os_atomic_set_long(&mailbox->ready, 2);
+}
+
+void frame_mailbox_init_queue(frame_mailbox_t *mailbox)
+{
+    memset(mailbox, 0, sizeof(*mailbox));
+
+    mailbox->queue       = true;
+    mailbox->write_index = 0;
+    os_atomic_set_long(&mailbox->head, 0);
+    os_atomic_set_long(&mailbox->tail, 0);
+}
+
+void frame_mailbox_free(frame_mailbox_t *mailbox)
+{
+    for (size_t i = 0; i < FRAME_MAILBOX_SLOTS; i++) {
+        pixel_pool_free(mailbox->slots[i].data, mailbox->slots[i].capacity);
+        bfree(mailbox->slots[i].rects);
+    }
+
+    memset(mailbox, 0, sizeof(*mailbox));
+}
+
+frame_slot_t *frame_mailbox_begin_write(frame_mailbox_t *mailbox, size_t size)
+{
+    frame_slot_t *slot = &mailbox->slots[mailbox->write_index];
+
+    // Slot buffers only ever grow, so steady-state frames reuse them.
+    if (slot->capacity < size) {
+        pixel_pool_free(slot->data, slot->capacity);
+        slot->data = pixel_pool_alloc(size, &slot->capacity);
+    }
+
+    slot->size       = size;
+    slot->partial    = false;
+    slot->rect_count = 0;
+    memset(slot->linesize, 0, sizeof(slot->linesize));
+    return slot;
+}
+
+frame_slot_t *frame_mailbox_reserve(frame_mailbox_t *mailbox, size_t size)
+{
+    frame_slot_t *slot = &mailbox->slots[mailbox->write_index];
+
+    pixel_pool_grow(&slot->data, &slot->capacity, slot->size, size);
+
+    return slot;
+}
+
+void frame_mailbox_add_rect(frame_slot_t *slot, const struct gs_image_rect *rect)
+{
+    if (slot->rect_count == slot->rect_capacity) {
+        slot->rect_capacity = slot->rect_capacity ? slot->rect_capacity * 2 : 16;
+        slot->rects = (struct gs_image_rect *)brealloc(
+            slot->rects,
+            slot->rect_capacity * sizeof(*slot->rects)
+        );
+    }
+
+    slot->rects[slot->rect_count++] = *rect;
+}
+
+// The consumer still holds the slot before `tail`, the next write slot must be
+// neither that one nor a queued one. Returns false if the queue is full.
+static bool frame_mailbox_push(frame_mailbox_t *mailbox)
+{
+    const long head = mailbox->head;
+    const long tail = os_atomic_load_long(&mailbox->tail);
+
+    if (head - tail >= FRAME_MAILBOX_QUEUE_DEPTH) {
+        return false;
+    }
+
+    mailbox->write_index = (head + 1) % FRAME_MAILBOX_SLOTS;
+    os_atomic_set_long(&mailbox->head, head + 1);
+    return true;
+}
+
+static bool frame_mailbox_publish_queue(frame_mailbox_t *mailbox)
+{
+    os_atomic_inc_long(&mailbox->published);
+
+    if (!frame_mailbox_push(mailbox)) {
+        os_atomic_inc_long(&mailbox->dropped);
+        return true;
+    }
+
+    return false;
+}
+
+bool frame_mailbox_publish(frame_mailbox_t *mailbox)
+{
+    if (mailbox->queue) {
+        return frame_mailbox_publish_queue(mailbox);
+    }
+
+    long prev = os_atomic_exchange_long(
+        &mailbox->ready,
+        mailbox->write_index | FRAME_MAILBOX_FRESH
+    );
+
+    // The slot we get back was either consumed already or is a stale frame
+    // the consumer never saw; either way it becomes the next write slot.
+    mailbox->write_index = prev & FRAME_MAILBOX_INDEX;
+
+    os_atomic_inc_long(&mailbox->published);
+    if (prev & FRAME_MAILBOX_FRESH) {
+        os_atomic_inc_long(&mailbox->dropped);
+        return true;
+    }
+
+    return false;
+}
+
+frame_slot_t *frame_mailbox_reclaim(frame_mailbox_t *mailbox)
+{
+    if (mailbox->queue) {
+        return NULL;
+    }
+
+    const long ready = os_atomic_load_long(&mailbox->ready);
+    if (!(ready & FRAME_MAILBOX_FRESH)) {
+        return NULL;
+    }
+
+    // The stale write slot goes in its place without the fresh bit, so the
+    // consumer never acquires it. Fails if the consumer got there first.
+    if (!os_atomic_compare_swap_long(&mailbox->ready, ready, mailbox->write_index)) {
+        return NULL;
+    }
+
+    mailbox->write_index = ready & FRAME_MAILBOX_INDEX;
+
+    // Published twice but acquired at most once, like a dropped frame.
+    os_atomic_inc_long(&mailbox->dropped);
+    return &mailbox->slots[mailbox->write_index];
+}
+
+bool frame_mailbox_retry(frame_mailbox_t *mailbox)
+{
+    if (!mailbox->queue) {
+        return false;
+    }
+
+    if (!frame_mailbox_push(mailbox)) {
+        return true;
+    }
+
+    // It was counted as dropped when it did not fit.
+    os_atomic_dec_long(&mailbox->dropped);
+    return false;
+}
+
+frame_slot_t *frame_mailbox_acquire(frame_mailbox_t *mailbox)
+{
+    if (mailbox->queue) {
+        const long tail = mailbox->tail;
+        if (os_atomic_load_long(&mailbox->head) == tail) {
+            return NULL;
+        }
+
+        mailbox->read_index = tail % FRAME_MAILBOX_SLOTS;
+        os_atomic_set_long(&mailbox->tail, tail + 1);
+        return &mailbox->slots[mailbox->read_index];
+    }
+
+    if (!(os_atomic_load_long(&mailbox->ready) & FRAME_MAILBOX_FRESH)) {
+        return NULL;
+    }
+
+    long prev = os_atomic_exchange_long(&mailbox->ready, mailbox->read_index);
+    mailbox->read_index = prev & FRAME_MAILBOX_INDEX;
+
+    return &mailbox->slots[mailbox->read_index];
+}
+
+long frame_mailbox_queued(const frame_mailbox_t *mailbox)
+{
+    return os_atomic_load_long(&mailbox->head) - mailbox->tail;
+}
+
+const frame_slot_t *frame_mailbox_peek(const frame_mailbox_t *mailbox, long index)
+{
+    if (index >= frame_mailbox_queued(mailbox)) {
+        return NULL;
+    }
+
+    return &mailbox->slots[(mailbox->tail + index) % FRAME_MAILBOX_SLOTS];
+}
+
+void frame_mailbox_skip(frame_mailbox_t *mailbox)
+{
+    if (frame_mailbox_acquire(mailbox)) {
+        os_atomic_inc_long(&mailbox->dropped);
+    }
+}
+
+long frame_mailbox_dropped(const frame_mailbox_t *mailbox)
+{
+    return os_atomic_load_long(&mailbox->dropped);
+}
@@ -0,0 +1,145 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <graphics/graphics.h>
+#include <media-io/video-io.h>
+
+#include "image-buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================================================== //
+// Frame mailbox
+//
+// Lock-free triple buffer between a single producer (receive thread) and a
+// single consumer (video thread). The producer always publishes its newest
+// frame; a published frame that was not picked up before the next publish is
+// dropped and counted instead of queued.
+//
+// In queue mode the slots form a FIFO instead, for consumers that pace
+// frames themselves. Up to FRAME_MAILBOX_QUEUE_DEPTH frames wait; when it is
+// full a publish does not go through and behaves like a dropped frame.
+// ========================================================================== //
+
+#define FRAME_MAILBOX_SLOTS         8
+#define FRAME_MAILBOX_QUEUE_DEPTH   (FRAME_MAILBOX_SLOTS - 2)
+
+struct frame_slot {
+    uint8_t                     *data;
+    size_t                      capacity;
+    size_t                      size;
+    uint32_t                    width;
+    uint32_t                    height;
+    enum gs_color_format        format;
+    int64_t                     id;
+
+    // Bytes between rows of each plane, the publisher's padding is kept.
+    // Zero for tightly packed planes.
+    uint32_t                    linesize[3];
+
+    // Planar YUV frame (VIDEO_FORMAT_NONE for packed RGB): `data` holds the
+    // planes back to back. `color_space` applies to packed RGB only.
+    enum video_format           video_format;
+    enum video_colorspace       colorspace;
+    enum gs_color_space         color_space;
+    enum video_range_type       range;
+    uint64_t                    timestamp;
+
+    // Publisher timestamp, 0 if it sent none.
+    uint64_t                    pts;
+
+    // Conversions left to the GPU: premultiplying straight alpha, and RGB
+    // instead of BGR order for VIDEO_FORMAT_BGR3.
+    bool                        straight_alpha;
+    bool                        swap_rb;
+
+    // Partial frame: `data` holds one tightly packed tile per rect.
+    bool                        partial;
+    struct gs_image_rect        *rects;
+    size_t                      rect_count;
+    size_t                      rect_capacity;
+};
+
+struct frame_mailbox {
+    struct frame_slot           slots[FRAME_MAILBOX_SLOTS];
+
+    long                        write_index;    // Producer only.
+    long                        read_index;     // Consumer only.
+    volatile long               ready;          // Slot index | FRAME_MAILBOX_FRESH.
+
+    // Queue mode: frames published and acquired so far.
+    bool                        queue;
+    volatile long               head;
+    volatile long               tail;
+
+    volatile long               published;
+    volatile long               dropped;
+};
+
+typedef struct frame_slot frame_slot_t;
+typedef struct frame_mailbox frame_mailbox_t;
+
+void frame_mailbox_init(frame_mailbox_t *mailbox);
+void frame_mailbox_init_queue(frame_mailbox_t *mailbox);
+void frame_mailbox_free(frame_mailbox_t *mailbox);
+
+// Producer side. Returns the write slot with room for at least `size` bytes.
+frame_slot_t *frame_mailbox_begin_write(frame_mailbox_t *mailbox, size_t size);
+
+// Producer side. Like begin_write, but keeps the slot contents, so a frame
+// can be appended to the one that was dropped from this slot.
+frame_slot_t *frame_mailbox_reserve(frame_mailbox_t *mailbox, size_t size);
+
+void frame_mailbox_add_rect(frame_slot_t *slot, const struct gs_image_rect *rect);
+
+// Returns true if the previously published frame was never acquired. In
+// queue mode the frame just published then did not fit and is still in the
+// write slot.
+bool frame_mailbox_publish(frame_mailbox_t *mailbox);
+
+// Producer side. Takes back the published frame if the consumer has not
+// acquired it yet: it becomes the write slot with its contents kept, to be
+// amended and published again. Returns NULL if it is gone (or in queue mode).
+frame_slot_t *frame_mailbox_reclaim(frame_mailbox_t *mailbox);
+
+// Producer side, queue mode. Publishes the write slot again after a publish
+// that did not fit. Returns true if it still does not fit.
+bool frame_mailbox_retry(frame_mailbox_t *mailbox);
+
+// Consumer side. Returns the newest published slot (the oldest queued one in
+// queue mode), or NULL if nothing was published since the last call. The
+// slot stays valid until the next successful acquire.
+frame_slot_t *frame_mailbox_acquire(frame_mailbox_t *mailbox);
+
+// Consumer side, queue mode. Number of frames waiting, and the `index`-th
+// oldest of them without acquiring it.
+long frame_mailbox_queued(const frame_mailbox_t *mailbox);
+const frame_slot_t *frame_mailbox_peek(const frame_mailbox_t *mailbox, long index);
+
+// Consumer side. Acquires and discards one frame, counted as dropped.
+void frame_mailbox_skip(frame_mailbox_t *mailbox);
+
+long frame_mailbox_dropped(const frame_mailbox_t *mailbox);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,1288 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "frame-manager.h"
+#include "decode-pool.h"
+#include "pixel-pool.h"
+#include "plugin-support.h"
+#include "stripe-codec.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+// ========================================================================== //
+// Parsing
+// ========================================================================== //
+static bool frame_manager_set_format(
+    frame_view_t                *view,
+    uint32_t                    pixel_format,
+    uint32_t                    stride
+) {
+    view->pixel_format = pixel_format;
+    view->format       = GS_UNKNOWN;
+    view->video_format = VIDEO_FORMAT_NONE;
+
+    switch (pixel_format) {
+    case OBS_PIPE_FORMAT_BGRA:          view->format       = GS_BGRA;           break;
+    case OBS_PIPE_FORMAT_RGBA:          view->format       = GS_RGBA;           break;
+    case OBS_PIPE_FORMAT_RGB24:         view->format       = GS_BGRA;           break;
+    case OBS_PIPE_FORMAT_BGR24:         view->format       = GS_BGRA;           break;
+    case OBS_PIPE_FORMAT_RGBA16F:       view->format       = GS_RGBA16F;        break;
+    case OBS_PIPE_FORMAT_R10G10B10A2:   view->format       = GS_R10G10B10A2;    break;
+    case OBS_PIPE_FORMAT_NV12:          view->video_format = VIDEO_FORMAT_NV12; break;
+    case OBS_PIPE_FORMAT_I420:          view->video_format = VIDEO_FORMAT_I420; break;
+    case OBS_PIPE_FORMAT_P010:          view->video_format = VIDEO_FORMAT_P010; break;
+    default:
+        obs_log(LOG_WARNING, "unsupported frame format: %u", pixel_format);
+        return false;
+    }
+
+    view->plane_count = obs_pipe_get_planes(pixel_format, view->width, view->height, stride, view->planes);
+    if (view->plane_count == 0) {
+        obs_log(LOG_WARNING, "invalid %ux%u frame for format %u", view->width, view->height, pixel_format);
+        return false;
+    }
+
+    for (size_t i = 0; i < view->plane_count; i++) {
+        if (view->planes[i].stride < view->planes[i].row_size) {
+            obs_log(LOG_WARNING, "frame stride %u is smaller than its rows", stride);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Bytes the planes span in the message, padding after the last row excluded.
+static size_t frame_view_span(const frame_view_t *view)
+{
+    size_t span = 0;
+
+    for (size_t i = 0; i < view->plane_count; i++) {
+        const struct obs_pipe_plane *plane = &view->planes[i];
+        if (plane->rows > 0) {
+            span += (size_t)plane->stride * (plane->rows - 1) + plane->row_size;
+        }
+        if (i + 1 < view->plane_count) {
+            span += plane->stride - plane->row_size;
+        }
+    }
+
+    return span;
+}
+
+static bool frame_view_is_packed(const frame_view_t *view)
+{
+    for (size_t i = 0; i < view->plane_count; i++) {
+        if (view->planes[i].stride != view->planes[i].row_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Slots keep the publisher's row pitch, the upload copies row by row anyway.
+static void frame_slot_set_linesize(frame_slot_t *slot, const frame_view_t *view)
+{
+    memset(slot->linesize, 0, sizeof(slot->linesize));
+    for (size_t i = 0; i < view->plane_count; i++) {
+        slot->linesize[i] = view->planes[i].stride;
+    }
+}
+
+static enum video_colorspace frame_manager_get_colorspace(uint32_t colorspace)
+{
+    switch (colorspace) {
+    case OBS_PIPE_CS_601:       return VIDEO_CS_601;
+    case OBS_PIPE_CS_709:       return VIDEO_CS_709;
+    case OBS_PIPE_CS_2100_PQ:   return VIDEO_CS_2100_PQ;
+    case OBS_PIPE_CS_2100_HLG:  return VIDEO_CS_2100_HLG;
+    default:                    return VIDEO_CS_DEFAULT;
+    }
+}
+
+// Colour space of RGB frames, as reported to libobs. Half floats default to
+// scRGB like Windows HDR captures, everything else to sRGB.
+static enum gs_color_space frame_manager_get_color_space(uint32_t colorspace, uint32_t format)
+{
+    switch (colorspace) {
+    case OBS_PIPE_CS_709_EXTENDED:  return GS_CS_709_EXTENDED;
+    case OBS_PIPE_CS_709_SCRGB:     return GS_CS_709_SCRGB;
+    default:
+        return format == OBS_PIPE_FORMAT_RGBA16F ? GS_CS_709_SCRGB : GS_CS_SRGB;
+    }
+}
+
+static bool frame_manager_parse_raw(
+    const uint8_t               *data,
+    size_t                      size,
+    frame_view_t                *view
+) {
+    obs_pipe_raw_header_t header;
+    obs_pipe_read_raw_header(data, &header);
+
+    view->width      = header.width;
+    view->height     = header.height;
+    view->id         = header.id;
+    view->timestamp  = header.timestamp;
+    view->timestamped = header.timestamp != 0;
+    view->flags      = header.version >= 5 ? header.flags : 0;
+    view->base_id    = header.base_id;
+    view->rects      = NULL;
+    view->rect_count = 0;
+    view->colorspace  = frame_manager_get_colorspace(header.colorspace);
+    view->color_space = frame_manager_get_color_space(header.colorspace, header.format);
+    view->range       = header.range == OBS_PIPE_RANGE_FULL ? VIDEO_RANGE_FULL : VIDEO_RANGE_PARTIAL;
+
+    size_t payload = size - header.header_size;
+
+    if (header.version < 9) {
+        view->flags &= ~(uint32_t)(OBS_PIPE_FLAG_KEYFRAME | OBS_PIPE_FLAG_DELTA);
+    }
+
+    if (view->flags & (OBS_PIPE_FLAG_KEYFRAME | OBS_PIPE_FLAG_DELTA)) {
+        const uint32_t bpp = obs_pipe_format_bpp(header.format);
+        if (header.rect_count > 0
+            || (header.format != OBS_PIPE_FORMAT_QOI_STRIPES && bpp != 4 && bpp != 8)) {
+            obs_log(LOG_WARNING, "raw frame %lld: delta and keyframes need a 32 or 64-bit RGB format without rects", (long long)header.id);
+            return false;
+        }
+    }
+
+    if (obs_pipe_format_is_compressed(header.format)) {
+        if (header.rect_count > 0) {
+            obs_log(LOG_WARNING, "raw frame %lld: compressed frames cannot carry dirty rects", (long long)header.id);
+            return false;
+        }
+
+        // Dimensions are only known once decoded.
+        view->pixel_format = header.format;
+        view->format       = GS_BGRA;
+        view->video_format = VIDEO_FORMAT_NONE;
+        view->plane_count  = 0;
+        view->pixels       = data + header.header_size;
+        view->size         = payload;
+        return true;
+    }
+
+    if (header.format == OBS_PIPE_FORMAT_QOI_STRIPES) {
+        if (header.rect_count > 0) {
+            obs_log(LOG_WARNING, "raw frame %lld: compressed frames cannot carry dirty rects", (long long)header.id);
+            return false;
+        }
+        if (!stripe_codec_validate(data + header.header_size, payload, header.width, header.height)) {
+            obs_log(LOG_WARNING, "raw frame %lld has an invalid stripe table", (long long)header.id);
+            return false;
+        }
+
+        // Described as the BGRA frame it decodes into, so conversion is
+        // picked like for any other.
+        frame_manager_set_format(view, OBS_PIPE_FORMAT_BGRA, 0);
+        view->pixel_format = header.format;
+        view->pixels       = data + header.header_size;
+        view->size         = payload;
+        return true;
+    }
+
+    if (obs_pipe_format_is_audio(header.format)) {
+        const uint64_t frame_size = (uint64_t)header.channels * obs_pipe_audio_sample_size(header.format);
+
+        if (header.channels == 0 || header.channels > MAX_AUDIO_CHANNELS || header.sample_rate == 0) {
+            obs_log(LOG_WARNING, "raw audio %lld: unsupported %u channels at %u Hz", (long long)header.id, header.channels, header.sample_rate);
+            return false;
+        }
+        if (payload % frame_size != 0) {
+            obs_log(LOG_WARNING, "raw audio %lld is truncated", (long long)header.id);
+            return false;
+        }
+
+        view->pixel_format = header.format;
+        view->format       = GS_UNKNOWN;
+        view->video_format = VIDEO_FORMAT_NONE;
+        view->plane_count  = 0;
+        view->pixels       = data + header.header_size;
+        view->size         = payload;
+        view->sample_rate  = header.sample_rate;
+        view->channels     = header.channels;
+        view->frames       = (uint32_t)(payload / frame_size);
+        return true;
+    }
+
+    if (!frame_manager_set_format(view, header.format, header.stride)) {
+        return false;
+    }
+
+    if ((view->colorspace == VIDEO_CS_2100_PQ || view->colorspace == VIDEO_CS_2100_HLG)
+        && header.format != OBS_PIPE_FORMAT_P010) {
+        obs_log(LOG_WARNING, "raw frame %lld: PQ and HLG frames need P010", (long long)header.id);
+        return false;
+    }
+
+    if (header.rect_count > 0) {
+        if (view->video_format != VIDEO_FORMAT_NONE || obs_pipe_format_is_packed24(header.format)) {
+            obs_log(LOG_WARNING, "raw frame %lld: dirty rects need a 32 or 64-bit RGB format", (long long)header.id);
+            return false;
+        }
+
+        const size_t rects_size = (size_t)header.rect_count * sizeof(obs_pipe_raw_rect_t);
+        if (rects_size > payload) {
+            obs_log(LOG_WARNING, "raw frame %lld is truncated", (long long)header.id);
+            return false;
+        }
+
+        view->rects      = data + header.header_size;
+        view->rect_count = header.rect_count;
+        view->pixels     = view->rects + rects_size;
+        payload         -= rects_size;
+
+        uint64_t tiles = 0;
+        for (uint32_t i = 0; i < header.rect_count; i++) {
+            obs_pipe_raw_rect_t rect;
+            memcpy(&rect, view->rects + i * sizeof(rect), sizeof(rect));
+
+            if ((uint64_t)rect.x + rect.width > header.width
+                || (uint64_t)rect.y + rect.height > header.height) {
+                obs_log(LOG_WARNING, "raw frame %lld has an out of bounds rect", (long long)header.id);
+                return false;
+            }
+            tiles += (uint64_t)rect.width * rect.height * obs_pipe_format_bpp(header.format);
+        }
+
+        if (tiles > payload) {
+            obs_log(LOG_WARNING, "raw frame %lld is truncated", (long long)header.id);
+            return false;
+        }
+
+        view->size = (size_t)tiles;
+        return true;
+    }
+
+    view->pixels = data + header.header_size;
+    view->size   = payload;
+
+    if (frame_view_span(view) > payload) {
+        obs_log(LOG_WARNING, "raw frame %lld is truncated", (long long)header.id);
+        return false;
+    }
+
+    return true;
+}
+
+static void frame_manager_view_proto(
+    const obs_pipe_frame_t      &msg,
+    frame_view_t                *view
+) {
+    view->pixels     = (const uint8_t *)msg.buffer().data();
+    view->size       = msg.buffer().size();
+    view->width      = msg.width();
+    view->height      = msg.height();
+    view->colorspace  = VIDEO_CS_DEFAULT;
+    view->color_space = GS_CS_SRGB;
+    view->range       = VIDEO_RANGE_FULL;
+    view->id          = msg.id();
+    view->timestamp   = 0;
+    view->timestamped = false;
+    view->flags       = 0;
+    view->base_id     = 0;
+    view->rects       = NULL;
+    view->rect_count  = 0;
+
+    frame_manager_set_format(view, OBS_PIPE_FORMAT_BGRA, 0);
+}
+
+// Picks the kernel applied while the frame is copied out of the message.
+// 24-bit frames are always expanded, straight alpha is premultiplied for the
+// texture only; libobs expects straight alpha from async sources. RGBA is
+// swizzled to BGRA on the way, it costs nothing extra.
+//
+// With GPU conversion the frame is copied as is and flagged instead, 24-bit
+// frames then travel as VIDEO_FORMAT_BGR3. The kernels only handle 8-bit
+// channels, high bit depth frames are always premultiplied on the GPU.
+static void frame_manager_set_convert(
+    frame_manager_t             *manager,
+    frame_view_t                *view
+) {
+    const bool packed24 = obs_pipe_format_is_packed24(view->pixel_format);
+    const bool straight = (manager->straight_alpha || (view->flags & OBS_PIPE_FLAG_STRAIGHT_ALPHA))
+        && !packed24
+        && view->video_format == VIDEO_FORMAT_NONE
+        && view->plane_count > 0
+        ;
+    const bool deep     = view->format == GS_RGBA16F || view->format == GS_R10G10B10A2;
+
+    view->convert        = NULL;
+    view->straight_alpha = false;
+    view->swap_rb        = false;
+
+    if ((manager->gpu_convert || deep) && !manager->async_output) {
+        if (packed24) {
+            view->video_format = VIDEO_FORMAT_BGR3;
+            view->swap_rb      = view->pixel_format == OBS_PIPE_FORMAT_RGB24;
+        }
+        view->straight_alpha = straight;
+        return;
+    }
+
+    if (packed24) {
+        view->convert = pixel_convert_get(3, view->pixel_format == OBS_PIPE_FORMAT_RGB24, PIXEL_CONVERT_ALPHA_KEEP);
+        return;
+    }
+
+    if (!straight || manager->async_output) {
+        return;
+    }
+
+    view->convert = pixel_convert_get(4, view->format == GS_RGBA, manager->premultiply);
+    view->format  = GS_BGRA;
+}
+
+// Accepts any message the pipe's transport allows. Protobuf frames are parsed
+// into manager->frame, so the view is only valid until the next parse. The
+// message is reused, so its buffer keeps its capacity between frames.
+static bool frame_manager_parse(
+    frame_manager_t             *manager,
+    const uint8_t               *data,
+    size_t                      size,
+    frame_view_t                *view
+) {
+    if (manager->transport != FRAME_TRANSPORT_PROTOBUF && obs_pipe_is_raw_frame(data, size)) {
+        if (!frame_manager_parse_raw(data, size, view)) {
+            return false;
+        }
+        if (!obs_pipe_format_is_audio(view->pixel_format)) {
+            frame_manager_set_convert(manager, view);
+        }
+        return true;
+    }
+
+    if (manager->transport == FRAME_TRANSPORT_RAW) {
+        obs_log(LOG_WARNING, "dropping message without raw frame header");
+        return false;
+    }
+
+    if (!manager->frame.ParseFromArray(data, (int)size)) {
+        obs_log(LOG_WARNING, "failed to parse frame message");
+        return false;
+    }
+
+    frame_manager_view_proto(manager->frame, view);
+    frame_manager_set_convert(manager, view);
+    return true;
+}
+
+// ========================================================================== //
+// Receive thread
+// ========================================================================== //
+
+static bool frame_view_needs_reconstruct(const frame_view_t *view)
+{
+    return view->pixel_format == OBS_PIPE_FORMAT_QOI_STRIPES
+        || (view->flags & (OBS_PIPE_FLAG_KEYFRAME | OBS_PIPE_FLAG_DELTA))
+        ;
+}
+
+static bool frame_manager_decode_stripes(
+    const frame_view_t          *view,
+    uint8_t                     *dst,
+    pixel_convert_fn            convert
+) {
+    if (!stripe_codec_decode(dst, view->pixels, view->size, view->width, view->height, convert)) {
+        obs_log(LOG_WARNING, "failed to decode striped frame %lld", (long long)view->id);
+        return false;
+    }
+    return true;
+}
+
+// Writes the frame's final pixels, tightly packed, into `dst` for frames
+// that are not just copied: striped frames are decoded, keyframes kept and
+// delta frames XORed with their keyframe. Conversion runs last, on rows
+// that are still in cache. Returns false if the frame has to be dropped.
+static bool frame_manager_reconstruct(
+    frame_manager_t             *manager,
+    const frame_view_t          *view,
+    uint8_t                     *dst
+) {
+    const bool      striped  = view->pixel_format == OBS_PIPE_FORMAT_QOI_STRIPES;
+    const size_t    row_size = view->planes[0].row_size;
+    const size_t    stride   = view->planes[0].stride;
+    const size_t    size     = row_size * view->height;
+    const size_t    pixels   = (size_t)view->width * view->height;
+
+    if (view->flags & OBS_PIPE_FLAG_DELTA) {
+        const bool has_key = manager->key_valid
+            && manager->key_id     == view->base_id
+            && manager->key_format == view->pixel_format
+            && manager->key_width  == view->width
+            && manager->key_height == view->height
+            ;
+        if (!has_key) {
+            manager->delta_dropped++;
+            return false;
+        }
+
+        const uint8_t *key = manager->key_pixels;
+
+        if (striped) {
+            if (!frame_manager_decode_stripes(view, dst, NULL)) {
+                return false;
+            }
+            for (uint32_t y = 0; y < view->height; y++) {
+                uint8_t *row = dst + y * row_size;
+                pixel_convert_xor(row, row, key + y * row_size, row_size);
+                if (view->convert) {
+                    view->convert(row, row, view->width);
+                }
+            }
+        } else {
+            for (uint32_t y = 0; y < view->height; y++) {
+                uint8_t *row = dst + y * row_size;
+                pixel_convert_xor(row, view->pixels + y * stride, key + y * row_size, row_size);
+                if (view->convert) {
+                    view->convert(row, row, view->width);
+                }
+            }
+        }
+        return true;
+    }
+
+    if (!(view->flags & OBS_PIPE_FLAG_KEYFRAME)) {
+        return frame_manager_decode_stripes(view, dst, view->convert);
+    }
+
+    // A keyframe that fails to decode must not serve later deltas.
+    manager->key_valid = false;
+
+    uint8_t *key = pixel_pool_grow(&manager->key_pixels, &manager->key_capacity, 0, size);
+
+    if (striped) {
+        if (!frame_manager_decode_stripes(view, key, NULL)) {
+            return false;
+        }
+    } else {
+        for (uint32_t y = 0; y < view->height; y++) {
+            memcpy(key + y * row_size, view->pixels + y * stride, row_size);
+        }
+    }
+
+    manager->key_valid  = true;
+    manager->key_id     = view->id;
+    manager->key_format = view->pixel_format;
+    manager->key_width  = view->width;
+    manager->key_height = view->height;
+
+    if (view->convert) {
+        view->convert(dst, key, pixels);
+    } else {
+        memcpy(dst, key, size);
+    }
+    return true;
+}
+
+// Copies `pixels` pixels of a tile, converting them on the way.
+static inline void frame_view_copy_tile(
+    const frame_view_t          *view,
+    uint8_t                     *dst,
+    const uint8_t               *src,
+    size_t                      pixels
+) {
+    if (view->convert) {
+        view->convert(dst, src, pixels);
+    } else {
+        memcpy(dst, src, pixels * obs_pipe_format_bpp(view->pixel_format));
+    }
+}
+
+static void frame_manager_publish_slot(
+    frame_manager_t             *manager,
+    frame_slot_t                *slot,
+    const frame_view_t          *view
+) {
+    slot->width          = view->width;
+    slot->height         = view->height;
+    slot->format         = view->format;
+    slot->video_format   = view->video_format;
+    slot->colorspace     = view->colorspace;
+    slot->color_space    = view->color_space;
+    slot->range          = view->range;
+    slot->id             = view->id;
+    slot->timestamp      = os_gettime_ns();
+    slot->pts            = view->timestamped ? view->timestamp : 0;
+    slot->straight_alpha = view->straight_alpha;
+    slot->swap_rb        = view->swap_rb;
+
+    // Only a queued frame that did not fit stays behind in the write slot,
+    // a dropped latest frame is superseded by the one just published.
+    manager->carry = frame_mailbox_publish(&manager->mailbox) && manager->mailbox.queue;
+}
+
+// Partial frames must not be lost when the video thread skips one, the tiles
+// of a dropped frame would never reach the texture. So the new tiles are
+// merged into the newest frame the consumer has not seen yet, taken back from
+// the mailbox (or left in the write slot by a full queue), and that frame is
+// published again right away.
+static void frame_manager_publish_rects(
+    frame_manager_t             *manager,
+    const frame_view_t          *view
+) {
+    frame_slot_t *slot = manager->carry
+        ? &manager->mailbox.slots[manager->mailbox.write_index]
+        : frame_mailbox_reclaim(&manager->mailbox);
+
+    const bool carry = slot
+        && slot->width  == view->width
+        && slot->height == view->height
+        && slot->format == view->format
+        ;
+
+    // Converted tiles keep their size, 8-bit RGBA in and BGRA out.
+    const size_t bpp        = obs_pipe_format_bpp(view->pixel_format);
+    const size_t frame_size = (size_t)view->width * view->height * bpp;
+
+    if (carry && !slot->partial) {
+        // Unseen full frame: patch the tiles into it, it stays a full frame.
+        const uint8_t *tile = view->pixels;
+        for (uint32_t i = 0; i < view->rect_count; i++) {
+            obs_pipe_raw_rect_t rect;
+            memcpy(&rect, view->rects + i * sizeof(rect), sizeof(rect));
+
+            const size_t row_size = (size_t)rect.width * bpp;
+            const size_t linesize = slot->linesize[0] ? slot->linesize[0] : (size_t)view->width * bpp;
+            for (uint32_t y = 0; y < rect.height; y++) {
+                frame_view_copy_tile(view, slot->data + (size_t)(rect.y + y) * linesize + rect.x * bpp, tile, rect.width);
+                tile += row_size;
+            }
+        }
+    } else {
+        size_t offset = 0;
+
+        if (carry && slot->size + view->size <= frame_size) {
+            offset = slot->size;
+            slot   = frame_mailbox_reserve(&manager->mailbox, offset + view->size);
+        } else {
+            if (carry) {
+                obs_log(LOG_WARNING, "too many unseen partial frames, image may be stale until the next full frame");
+            }
+            slot = frame_mailbox_begin_write(&manager->mailbox, view->size);
+            slot->partial = true;
+        }
+
+        frame_view_copy_tile(view, slot->data + offset, view->pixels, view->size / bpp);
+        slot->size = offset + view->size;
+
+        for (uint32_t i = 0; i < view->rect_count; i++) {
+            obs_pipe_raw_rect_t rect;
+            memcpy(&rect, view->rects + i * sizeof(rect), sizeof(rect));
+
+            struct gs_image_rect image_rect = {rect.x, rect.y, rect.width, rect.height};
+            frame_mailbox_add_rect(slot, &image_rect);
+        }
+    }
+
+    frame_manager_publish_slot(manager, slot, view);
+}
+
+static void frame_manager_publish(
+    frame_manager_t             *manager,
+    const frame_view_t          *view
+) {
+    std::lock_guard<std::mutex> lock(manager->publish_mutex);
+
+    if (view->rect_count > 0) {
+        frame_manager_publish_rects(manager, view);
+        return;
+    }
+
+    if (frame_view_needs_reconstruct(view)) {
+        const size_t size = (size_t)view->planes[0].row_size * view->height;
+        frame_slot_t *slot = frame_mailbox_begin_write(&manager->mailbox, size);
+
+        if (frame_manager_reconstruct(manager, view, slot->data)) {
+            frame_manager_publish_slot(manager, slot, view);
+        } else {
+            // Whatever was carried in the write slot is overwritten now.
+            manager->carry = false;
+        }
+        return;
+    }
+
+    if (frame_view_span(view) > view->size) {
+        obs_log(LOG_WARNING, "frame %lld is smaller than its dimensions", (long long)view->id);
+        return;
+    }
+
+    // Unconverted frames are copied in one go, padding included.
+    const size_t size = view->convert
+        ? (size_t)view->width * view->height * 4
+        : frame_view_span(view);
+
+    // The write slot is never visible to the video thread, copy freely.
+    frame_slot_t *slot = frame_mailbox_begin_write(&manager->mailbox, size);
+
+    if (view->convert) {
+        const struct obs_pipe_plane *plane = &view->planes[0];
+
+        if (frame_view_is_packed(view)) {
+            view->convert(slot->data, view->pixels, (size_t)view->width * view->height);
+        } else {
+            for (uint32_t y = 0; y < plane->rows; y++) {
+                view->convert(slot->data + (size_t)y * view->width * 4, view->pixels + (size_t)y * plane->stride, view->width);
+            }
+        }
+    } else {
+        memcpy(slot->data, view->pixels, size);
+        frame_slot_set_linesize(slot, view);
+    }
+
+    frame_manager_publish_slot(manager, slot, view);
+}
+
+// libobs copies the planes into its own frame cache and takes care of
+// buffering and presentation against the publisher timestamps.
+static void frame_manager_output_async(
+    frame_manager_t             *manager,
+    const frame_view_t          *view
+) {
+    if (view->rect_count > 0) {
+        if (!manager->async_rects_warned) {
+            obs_log(LOG_WARNING, "async sources do not support partial frames, dropping them");
+            manager->async_rects_warned = true;
+        }
+        return;
+    }
+
+    const bool reconstruct = frame_view_needs_reconstruct(view);
+
+    if (view->pixel_format != OBS_PIPE_FORMAT_QOI_STRIPES && frame_view_span(view) > view->size) {
+        obs_log(LOG_WARNING, "frame %lld is smaller than its dimensions", (long long)view->id);
+        return;
+    }
+
+    // libobs has no video format for high bit depth RGB.
+    if (view->video_format == VIDEO_FORMAT_NONE && view->format != GS_BGRA && view->format != GS_RGBA) {
+        if (!manager->async_format_warned) {
+            obs_log(LOG_WARNING, "async sources do not support RGBA16F and R10G10B10A2 frames, dropping them");
+            manager->async_format_warned = true;
+        }
+        return;
+    }
+
+    struct obs_source_frame frame = {};
+
+    if (reconstruct || view->convert) {
+        const size_t row_size = (size_t)view->width * 4;
+        pixel_pool_grow(&manager->async_pixels, &manager->async_capacity, 0, row_size * view->height);
+
+        if (reconstruct) {
+            if (!frame_manager_reconstruct(manager, view, manager->async_pixels)) {
+                return;
+            }
+        } else {
+            for (uint32_t y = 0; y < view->height; y++) {
+                view->convert(manager->async_pixels + y * row_size, view->pixels + (size_t)y * view->planes[0].stride, view->width);
+            }
+        }
+
+        frame.data[0]     = manager->async_pixels;
+        frame.linesize[0] = (uint32_t)row_size;
+    } else {
+        const uint8_t *plane = view->pixels;
+
+        for (size_t i = 0; i < view->plane_count; i++) {
+            frame.data[i]     = (uint8_t *)plane;
+            frame.linesize[i] = view->planes[i].stride;
+            plane += (size_t)view->planes[i].stride * view->planes[i].rows;
+        }
+    }
+
+    frame.width     = view->width;
+    frame.height    = view->height;
+    frame.timestamp = view->timestamp;
+
+    if (view->video_format != VIDEO_FORMAT_NONE) {
+        frame.format     = view->video_format;
+        frame.full_range = view->range == VIDEO_RANGE_FULL;
+        video_format_get_parameters_for_format(
+            view->colorspace,
+            view->range,
+            view->video_format,
+            frame.color_matrix,
+            frame.color_range_min,
+            frame.color_range_max
+        );
+        frame.trc = view->colorspace == VIDEO_CS_2100_PQ  ? VIDEO_TRC_PQ
+                  : view->colorspace == VIDEO_CS_2100_HLG ? VIDEO_TRC_HLG
+                  : VIDEO_TRC_DEFAULT;
+    } else {
+        frame.format = view->format == GS_RGBA ? VIDEO_FORMAT_RGBA : VIDEO_FORMAT_BGRA;
+    }
+
+    obs_source_output_video(manager->async_output, &frame);
+}
+
+static enum speaker_layout frame_manager_get_speakers(uint32_t channels)
+{
+    switch (channels) {
+    case 1:  return SPEAKERS_MONO;
+    case 2:  return SPEAKERS_STEREO;
+    case 3:  return SPEAKERS_2POINT1;
+    case 4:  return SPEAKERS_4POINT0;
+    case 5:  return SPEAKERS_4POINT1;
+    case 6:  return SPEAKERS_5POINT1;
+    case 8:  return SPEAKERS_7POINT1;
+    default: return SPEAKERS_UNKNOWN;
+    }
+}
+
+// Audio goes out from the receive thread like async video. Both carry the
+// publisher's timestamps, libobs lines them up against each other.
+static void frame_manager_output_audio(
+    frame_manager_t             *manager,
+    const frame_view_t          *view
+) {
+    const enum speaker_layout speakers = frame_manager_get_speakers(view->channels);
+
+    if (!manager->async_output || speakers == SPEAKERS_UNKNOWN) {
+        if (!manager->audio_warned) {
+            obs_log(
+                LOG_WARNING,
+                "%s, dropping audio",
+                manager->async_output ? "unsupported audio channel count" : "audio needs an async pipe source"
+            );
+            manager->audio_warned = true;
+        }
+        return;
+    }
+
+    struct obs_source_audio audio = {};
+
+    switch (view->pixel_format) {
+    case OBS_PIPE_FORMAT_AUDIO_S16:  audio.format = AUDIO_FORMAT_16BIT;        break;
+    case OBS_PIPE_FORMAT_AUDIO_S32:  audio.format = AUDIO_FORMAT_32BIT;        break;
+    case OBS_PIPE_FORMAT_AUDIO_F32:  audio.format = AUDIO_FORMAT_FLOAT;        break;
+    case OBS_PIPE_FORMAT_AUDIO_F32P: audio.format = AUDIO_FORMAT_FLOAT_PLANAR; break;
+    }
+
+    if (audio.format == AUDIO_FORMAT_FLOAT_PLANAR) {
+        const size_t plane_size = (size_t)view->frames * sizeof(float);
+        for (uint32_t i = 0; i < view->channels; i++) {
+            audio.data[i] = view->pixels + i * plane_size;
+        }
+    } else {
+        audio.data[0] = view->pixels;
+    }
+
+    audio.frames          = view->frames;
+    audio.speakers        = speakers;
+    audio.samples_per_sec = view->sample_rate;
+    audio.timestamp       = view->timestamp;
+
+    obs_source_output_audio(manager->async_output, &audio);
+}
+
+// ========================================================================== //
+// Decode pool
+// ========================================================================== //
+static void frame_manager_publish_decoded(frame_decode_job_t *job, uint32_t cx, uint32_t cy)
+{
+    frame_manager_t *manager = job->manager;
+
+    std::lock_guard<std::mutex> lock(manager->publish_mutex);
+
+    // Another worker already published a later frame.
+    if (job->seq <= manager->decode_last_seq) {
+        os_atomic_inc_long(&manager->decode_dropped);
+        return;
+    }
+    manager->decode_last_seq = job->seq;
+
+    frame_view_t view = {};
+    view.pixels         = job->pixels;
+    view.size           = (size_t)cx * cy * 4;
+    view.width          = cx;
+    view.height         = cy;
+    view.colorspace     = VIDEO_CS_DEFAULT;
+    view.color_space    = GS_CS_SRGB;
+    view.range          = VIDEO_RANGE_FULL;
+    view.id             = job->id;
+    view.timestamp      = job->timestamp;
+    view.timestamped    = job->timestamped;
+    view.straight_alpha = manager->gpu_convert;
+    frame_manager_set_format(&view, OBS_PIPE_FORMAT_BGRA, 0);
+
+    if (manager->async_output) {
+        frame_manager_output_async(manager, &view);
+        return;
+    }
+
+    // Hand the decoded buffer over instead of copying it, the slot's old
+    // buffer becomes this job's next decode target.
+    frame_slot_t *slot = frame_mailbox_begin_write(&manager->mailbox, 0);
+    std::swap(slot->data,     job->pixels);
+    std::swap(slot->capacity, job->capacity);
+    slot->size = view.size;
+
+    frame_manager_publish_slot(manager, slot, &view);
+}
+
+static void frame_manager_decode_task(void *param)
+{
+    frame_decode_job_t  *job     = (frame_decode_job_t *)param;
+    frame_manager_t     *manager = job->manager;
+
+    for (;;) {
+        uint32_t cx = 0;
+        uint32_t cy = 0;
+
+        if (!job->decoder) {
+            job->decoder = image_decoder_create();
+        }
+
+        uint8_t *pixels = image_decoder_decode(
+            job->decoder,
+            (const uint8_t *)job->payload.data(),
+            job->payload.size(),
+            &job->pixels,
+            &job->capacity,
+            &cx,
+            &cy
+        );
+
+        if (pixels) {
+            // Decoders output straight alpha, the texture wants it
+            // premultiplied.
+            if (!manager->async_output && !manager->gpu_convert) {
+                pixel_convert_get(4, false, manager->premultiply)(pixels, pixels, (size_t)cx * cy);
+            }
+            frame_manager_publish_decoded(job, cx, cy);
+        } else {
+            obs_log(LOG_WARNING, "failed to decode frame %lld", (long long)job->id);
+        }
+
+        std::lock_guard<std::mutex> lock(manager->decode_mutex);
+        if (!manager->decode_has_pending) {
+            job->busy = false;
+            manager->decode_idle.notify_all();
+            return;
+        }
+
+        std::swap(job->payload, manager->decode_pending.payload);
+        job->id           = manager->decode_pending.id;
+        job->seq          = manager->decode_pending.seq;
+        job->timestamp    = manager->decode_pending.timestamp;
+        job->timestamped  = manager->decode_pending.timestamped;
+        manager->decode_has_pending = false;
+    }
+}
+
+static void frame_manager_submit_decode(
+    frame_manager_t             *manager,
+    const frame_view_t          *view
+) {
+    std::unique_lock<std::mutex> lock(manager->decode_mutex);
+
+    for (size_t i = 0; i < FRAME_DECODE_JOBS; i++) {
+        frame_decode_job_t *job = &manager->decode_jobs[i];
+        if (job->busy) {
+            continue;
+        }
+
+        job->manager      = manager;
+        job->busy         = true;
+        job->id           = view->id;
+        job->seq          = ++manager->decode_next_seq;
+        job->timestamp    = view->timestamp;
+        job->timestamped  = view->timestamped;
+        job->payload.assign((const char *)view->pixels, view->size);
+        lock.unlock();
+
+        decode_pool_push(frame_manager_decode_task, job);
+        return;
+    }
+
+    // All workers busy: keep only the newest frame for whoever finishes first.
+    if (manager->decode_has_pending) {
+        os_atomic_inc_long(&manager->decode_dropped);
+    }
+
+    frame_decode_job_t *pending = &manager->decode_pending;
+    pending->id           = view->id;
+    pending->seq          = ++manager->decode_next_seq;
+    pending->timestamp    = view->timestamp;
+    pending->timestamped  = view->timestamped;
+    pending->payload.assign((const char *)view->pixels, view->size);
+    manager->decode_has_pending = true;
+}
+
+// ========================================================================== //
+// Delivery
+// ========================================================================== //
+static void frame_manager_deliver(
+    frame_manager_t             *manager,
+    frame_view_t                *view,
+    long long                   send_time
+) {
+    if (view->timestamp == 0) {
+        view->timestamp = (uint64_t)send_time * 1000;
+    }
+
+    if (obs_pipe_format_is_audio(view->pixel_format)) {
+        frame_manager_output_audio(manager, view);
+    } else if (obs_pipe_format_is_compressed(view->pixel_format)) {
+        frame_manager_submit_decode(manager, view);
+    } else if (manager->async_output) {
+        frame_manager_output_async(manager, view);
+    } else {
+        frame_manager_publish(manager, view);
+    }
+}
+
+static void frame_manager_on_receive_raw(
+    frame_manager_t                     *manager,
+    const eCAL::SReceiveCallbackData    *data
+) {
+    // With a shared-memory layer `data->buf` points into the eCAL memory file
+    // and is only valid during this callback; the copy into the write slot is
+    // the only one made for raw frames.
+    frame_view_t view;
+    if (frame_manager_parse(manager, (const uint8_t *)data->buf, (size_t)data->size, &view)) {
+        frame_manager_deliver(manager, &view, data->time);
+    }
+}
+
+// ========================================================================== //
+// Subscription
+// ========================================================================== //
+static void frame_manager_subscribe(frame_manager_t *manager)
+{
+    if (manager->pipe_name.empty()) {
+        return;
+    }
+
+    const char *pipe_name = manager->pipe_name.c_str();
+
+    // The typed subscriber deserializes every callback into a fresh message,
+    // so callbacks always take the raw subscriber and parse into the reused
+    // scratch message. Polling receives into the scratch message directly.
+    if (manager->transport == FRAME_TRANSPORT_PROTOBUF && manager->mode == FRAME_RECEIVE_POLL) {
+        obs_log(LOG_INFO, "creating subscriber");
+        manager->subscriber.Create(pipe_name);
+    } else {
+        obs_log(LOG_INFO, "creating raw subscriber");
+        manager->raw_subscriber.Create(pipe_name);
+
+        if (manager->mode == FRAME_RECEIVE_CALLBACK) {
+            manager->raw_subscriber.AddReceiveCallback(
+                [manager](const char *topic_name, const eCAL::SReceiveCallbackData *data) {
+                    UNUSED_PARAMETER(topic_name);
+                    frame_manager_on_receive_raw(manager, data);
+                }
+            );
+        }
+    }
+}
+
+static void frame_manager_unsubscribe(frame_manager_t *manager)
+{
+    // Destroy() joins the receive thread, no callback runs after this.
+    if (manager->subscriber.IsCreated()) {
+        manager->subscriber.RemReceiveCallback();
+        manager->subscriber.Destroy();
+    }
+    if (manager->raw_subscriber.IsCreated()) {
+        manager->raw_subscriber.RemReceiveCallback();
+        manager->raw_subscriber.Destroy();
+    }
+}
+
+void frame_manager_pause(frame_manager_t *manager)
+{
+    if (manager->paused) {
+        return;
+    }
+
+    obs_log(LOG_DEBUG, "pausing subscriber for '%s'", manager->pipe_name.c_str());
+    frame_manager_unsubscribe(manager);
+    manager->paused = true;
+}
+
+void frame_manager_resume(frame_manager_t *manager)
+{
+    if (!manager->paused) {
+        return;
+    }
+
+    obs_log(LOG_DEBUG, "resuming subscriber for '%s'", manager->pipe_name.c_str());
+    manager->paused = false;
+    frame_manager_subscribe(manager);
+}
+
+// ========================================================================== //
+// Frame Manager
+// ========================================================================== //
+// Frames the jitter delay holds at the OBS frame rate. A backlog beyond that
+// is more than jitter and is dropped.
+static long frame_manager_jitter_frames(uint64_t delay)
+{
+    struct obs_video_info ovi;
+    if (!obs_get_video_info(&ovi) || ovi.fps_num == 0) {
+        return 1;
+    }
+
+    const uint64_t interval = 1000000000ULL * ovi.fps_den / ovi.fps_num;
+    const uint64_t frames   = interval ? delay / interval : 0;
+
+    return frames < 1 ? 1
+         : frames > FRAME_MAILBOX_QUEUE_DEPTH ? FRAME_MAILBOX_QUEUE_DEPTH
+         : (long)frames;
+}
+
+void frame_manager_open(
+    frame_manager_t                 *manager,
+    const frame_manager_config_t    *config
+) {
+    frame_manager_close(manager);
+
+    const enum frame_transport transport = config->transport;
+
+    // Async output is pushed from the receive thread, polling makes no sense.
+    const enum frame_receive_mode mode = config->async_output
+        ? FRAME_RECEIVE_CALLBACK
+        : config->mode;
+
+    // Pacing needs the receive thread to queue frames, async sources are
+    // paced by OBS from their timestamps.
+    const enum frame_pacing pacing = mode == FRAME_RECEIVE_CALLBACK && !config->async_output
+        ? config->pacing
+        : FRAME_PACING_LATEST;
+
+    manager->pipe_name           = config->pipe_name ? config->pipe_name : "";
+    manager->mode                = mode;
+    manager->transport           = transport;
+    manager->pacing              = pacing;
+    manager->jitter_delay        = (uint64_t)config->jitter_delay_ms * 1000000;
+    manager->jitter_frames       = frame_manager_jitter_frames(manager->jitter_delay);
+    manager->straight_alpha      = config->straight_alpha;
+    manager->gpu_convert         = config->gpu_convert;
+    manager->premultiply         = config->linear_alpha
+        ? PIXEL_CONVERT_ALPHA_PREMULTIPLY_SRGB
+        : PIXEL_CONVERT_ALPHA_PREMULTIPLY;
+    manager->async_output        = config->async_output;
+    manager->async_rects_warned  = false;
+    manager->async_format_warned = false;
+    manager->audio_warned        = false;
+    manager->carry               = false;
+    manager->decode_has_pending  = false;
+    manager->decode_next_seq     = 0;
+    manager->decode_last_seq     = 0;
+    manager->decode_dropped      = 0;
+    manager->key_valid           = false;
+    manager->delta_dropped       = 0;
+    manager->last_dropped        = 0;
+    manager->burst               = false;
+
+    if (pacing == FRAME_PACING_LATEST) {
+        frame_mailbox_init(&manager->mailbox);
+    } else {
+        frame_mailbox_init_queue(&manager->mailbox);
+    }
+
+    if (!manager->paused) {
+        frame_manager_subscribe(manager);
+    }
+}
+
+void frame_manager_close(frame_manager_t *manager)
+{
+    frame_manager_unsubscribe(manager);
+
+    // Decode jobs still running publish into the mailbox, wait for them.
+    {
+        std::unique_lock<std::mutex> lock(manager->decode_mutex);
+        manager->decode_has_pending = false;
+        manager->decode_idle.wait(lock, [manager] {
+            for (size_t i = 0; i < FRAME_DECODE_JOBS; i++) {
+                if (manager->decode_jobs[i].busy) {
+                    return false;
+                }
+            }
+            return true;
+        });
+
+        for (size_t i = 0; i < FRAME_DECODE_JOBS; i++) {
+            image_decoder_destroy(manager->decode_jobs[i].decoder);
+            pixel_pool_free(manager->decode_jobs[i].pixels, manager->decode_jobs[i].capacity);
+            manager->decode_jobs[i].decoder  = NULL;
+            manager->decode_jobs[i].pixels   = NULL;
+            manager->decode_jobs[i].capacity = 0;
+            manager->decode_jobs[i].payload.clear();
+        }
+        manager->decode_pending.payload.clear();
+    }
+
+    if (manager->decode_dropped > 0) {
+        obs_log(LOG_DEBUG, "frame decoder: %ld stale frames dropped", manager->decode_dropped);
+    }
+
+    if (manager->delta_dropped > 0) {
+        obs_log(LOG_DEBUG, "delta frames: %ld dropped without their keyframe", manager->delta_dropped);
+    }
+
+    if (manager->mailbox.published > 0) {
+        obs_log(
+            LOG_DEBUG,
+            "frame mailbox: %ld published, %ld dropped",
+            manager->mailbox.published,
+            frame_mailbox_dropped(&manager->mailbox)
+        );
+    }
+
+    frame_mailbox_free(&manager->mailbox);
+    pixel_pool_free(manager->async_pixels, manager->async_capacity);
+    pixel_pool_free(manager->key_pixels, manager->key_capacity);
+    manager->async_pixels   = NULL;
+    manager->async_capacity = 0;
+    manager->key_pixels     = NULL;
+    manager->key_capacity   = 0;
+    manager->frame.Clear();
+    manager->poll_buffer.clear();
+    memset(&manager->poll_slot, 0, sizeof(manager->poll_slot));
+}
+
+static const frame_slot_t *frame_manager_poll(frame_manager_t *manager)
+{
+    frame_view_t view;
+
+    if (manager->transport == FRAME_TRANSPORT_PROTOBUF) {
+        if (!manager->subscriber.Receive(manager->frame)) {
+            return frame_mailbox_acquire(&manager->mailbox);
+        }
+        frame_manager_view_proto(manager->frame, &view);
+        frame_manager_set_convert(manager, &view);
+    } else {
+        std::string &buffer = manager->poll_buffer;
+        if (!manager->raw_subscriber.ReceiveBuffer(buffer, nullptr, 0)) {
+            return frame_mailbox_acquire(&manager->mailbox);
+        }
+        if (!frame_manager_parse(manager, (const uint8_t *)buffer.data(), buffer.size(), &view)) {
+            return NULL;
+        }
+    }
+
+    // Polling is for sync sources, which cannot play audio.
+    if (obs_pipe_format_is_audio(view.pixel_format)) {
+        frame_manager_output_audio(manager, &view);
+        return frame_mailbox_acquire(&manager->mailbox);
+    }
+
+    // Compressed frames are decoded on the pool and show up in the mailbox
+    // on a later tick.
+    if (obs_pipe_format_is_compressed(view.pixel_format)) {
+        frame_manager_submit_decode(manager, &view);
+        return frame_mailbox_acquire(&manager->mailbox);
+    }
+
+    // Converted, striped and delta frames need a copy and partial frames
+    // their rects, they go through the mailbox on this thread. Padded rows
+    // are uploaded as is.
+    if (view.convert || view.rect_count > 0 || frame_view_needs_reconstruct(&view)) {
+        frame_manager_publish(manager, &view);
+        return frame_mailbox_acquire(&manager->mailbox);
+    }
+
+    frame_slot_t *slot = &manager->poll_slot;
+    slot->data           = (uint8_t *)view.pixels;
+    slot->size           = view.size;
+    slot->capacity       = view.size;
+    frame_slot_set_linesize(slot, &view);
+    slot->width          = view.width;
+    slot->height         = view.height;
+    slot->format         = view.format;
+    slot->video_format   = view.video_format;
+    slot->colorspace     = view.colorspace;
+    slot->color_space    = view.color_space;
+    slot->range          = view.range;
+    slot->id             = view.id;
+    slot->timestamp      = os_gettime_ns();
+    slot->pts            = view.timestamped ? view.timestamp : 0;
+    slot->straight_alpha = view.straight_alpha;
+    slot->swap_rb        = view.swap_rb;
+    return slot;
+}
+
+const frame_slot_t *frame_manager_receive(frame_manager_t *manager)
+{
+    if (!manager->subscriber.IsCreated() && !manager->raw_subscriber.IsCreated()) {
+        return NULL;
+    }
+
+    if (manager->mode == FRAME_RECEIVE_POLL) {
+        return frame_manager_poll(manager);
+    }
+
+    frame_mailbox_t *mailbox = &manager->mailbox;
+
+    if (manager->pacing == FRAME_PACING_LATEST) {
+        const long dropped = frame_mailbox_dropped(mailbox);
+        manager->burst        = dropped != manager->last_dropped;
+        manager->last_dropped = dropped;
+        return frame_mailbox_acquire(mailbox);
+    }
+
+    // A frame that did not fit in the queue waits in the write slot. Push it
+    // now that the last acquire made room, the publisher may have gone idle.
+    // A busy producer will merge it into its next frame anyway.
+    {
+        std::unique_lock<std::mutex> lock(manager->publish_mutex, std::try_to_lock);
+        if (lock.owns_lock() && manager->carry) {
+            manager->carry = frame_mailbox_retry(mailbox);
+        }
+    }
+
+    long ready = frame_mailbox_queued(mailbox);
+
+    if (manager->pacing == FRAME_PACING_JITTER_BUFFER) {
+        // Only frames that sat out the delay are due, the oldest is shown.
+        const uint64_t now = os_gettime_ns();
+        long due = 0;
+        while (due < ready && frame_mailbox_peek(mailbox, due)->timestamp + manager->jitter_delay <= now) {
+            due++;
+        }
+        ready = due;
+    }
+
+    // A burst that arrived together becomes due together and drains one
+    // frame per tick, up to as many frames as the delay covers. Rate
+    // conversion keeps one frame of slack so a publisher running at the same
+    // rate never loses frames to tick jitter.
+    const long keep = manager->pacing == FRAME_PACING_JITTER_BUFFER
+        ? manager->jitter_frames
+        : 2;
+
+    manager->burst = ready > keep;
+    if (ready == 0) {
+        return NULL;
+    }
+
+    // Tiles of a skipped partial frame would never reach the texture.
+    for (; ready > keep && !frame_mailbox_peek(mailbox, 0)->partial; ready--) {
+        frame_mailbox_skip(mailbox);
+    }
+
+    return frame_mailbox_acquire(mailbox);
+}
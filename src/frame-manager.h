@@ -0,0 +1,245 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include <obs.h>
+#include <ecal/ecal.h>
+#include <ecal/msg/protobuf/subscriber.h>
+
+#include "frame-mailbox.h"
+#include "image-decoder.h"
+#include "pipe-frame.h"
+#include "pixel-convert.h"
+#include "proto/frame.pb.h"
+
+// ========================================================================== //
+// Structures
+// ========================================================================== //
+
+typedef eCAL::protobuf::CSubscriber<ObsPipe::Proto::Frame> obs_pipe_subscriber_t;
+typedef eCAL::CSubscriber obs_pipe_raw_subscriber_t;
+typedef ObsPipe::Proto::Frame obs_pipe_frame_t;
+
+enum frame_receive_mode {
+    // Receive() is called from the video tick, parse included.
+    FRAME_RECEIVE_POLL      = 0,
+    // eCAL receive callback parses on the subscriber thread and publishes
+    // into the frame mailbox, the tick only picks up the newest ready slot.
+    FRAME_RECEIVE_CALLBACK  = 1,
+};
+
+enum frame_transport {
+    // Raw subscriber, each message is checked for the raw header and parsed
+    // as a protobuf `Frame` otherwise.
+    FRAME_TRANSPORT_AUTO        = 0,
+    // Protobuf `Frame` messages only, the original wire format.
+    FRAME_TRANSPORT_PROTOBUF    = 1,
+    // Raw subscriber, messages without the raw header are rejected.
+    FRAME_TRANSPORT_RAW         = 2,
+};
+
+// How the video thread picks frames out of the mailbox, callback mode only.
+enum frame_pacing {
+    // Newest frame each tick, anything older is dropped.
+    FRAME_PACING_LATEST         = 0,
+    // Frames are held for a fixed delay after they were received and then
+    // shown in order, one per tick, absorbing jitter in the publisher or the
+    // network. Only a backlog longer than the delay is dropped.
+    FRAME_PACING_JITTER_BUFFER  = 1,
+    // One frame per tick in order, repeating the last one when none arrived.
+    // Two frames of slack are kept, when more pile up because the publisher
+    // runs faster than OBS the oldest are dropped.
+    FRAME_PACING_RATE_CONVERT   = 2,
+};
+
+// Parsed frame pointing into the received message.
+struct frame_view_t {
+    const uint8_t           *pixels;
+    size_t                  size;
+    uint32_t                width;
+    uint32_t                height;
+    uint32_t                pixel_format;   // enum obs_pipe_pixel_format
+    size_t                  plane_count;
+    struct obs_pipe_plane   planes[OBS_PIPE_MAX_PLANES];
+    enum gs_color_format    format;
+    enum video_format       video_format;
+    enum video_colorspace   colorspace;
+    enum gs_color_space     color_space;    // RGB formats.
+    enum video_range_type   range;
+    int64_t                 id;
+    uint64_t                timestamp;      // Publisher clock, ns.
+    bool                    timestamped;    // Not the send time fallback.
+    uint32_t                flags;          // enum obs_pipe_flags
+    int64_t                 base_id;        // Keyframe of a delta frame.
+
+    // Applied while copying out of the message, `format` is the result.
+    // With GPU conversion the flags below are passed on instead.
+    pixel_convert_fn        convert;
+    bool                    straight_alpha;
+    bool                    swap_rb;
+
+    // Partial frame: `pixels` holds one packed tile per rect. Rects point
+    // into the message and may be unaligned.
+    const uint8_t           *rects;
+    uint32_t                rect_count;
+
+    // Audio message: `pixels` holds the samples, `pixel_format` their
+    // format.
+    uint32_t                sample_rate;
+    uint32_t                channels;
+    uint32_t                frames;
+};
+
+// Concurrent decodes per pipe, further compressed frames wait in a single
+// pending slot where the newest one wins.
+#define FRAME_DECODE_JOBS 2
+
+struct frame_manager_t;
+
+// One in-flight decode on the decode pool. Buffers are kept across frames.
+struct frame_decode_job_t {
+    frame_manager_t         *manager;
+    bool                    busy;
+    image_decoder_t         *decoder;
+    std::string             payload;
+    int64_t                 id;
+    uint64_t                seq;        // Submission order.
+    uint64_t                timestamp;
+    bool                    timestamped;
+    uint8_t                 *pixels;
+    size_t                  capacity;
+};
+
+struct frame_manager_config_t {
+    const char              *pipe_name;
+    enum frame_receive_mode mode;
+    enum frame_transport    transport;
+    enum frame_pacing       pacing;
+    uint32_t                jitter_delay_ms;
+
+    // Every frame carries straight alpha, not just the flagged ones. It is
+    // premultiplied in linear light with `linear_alpha`.
+    bool                    straight_alpha;
+    bool                    linear_alpha;
+
+    // Leave premultiplying and 24-bit expansion to the GPU, sync sources
+    // only.
+    bool                    gpu_convert;
+
+    // Async sources: frames are handed to obs_source_output_video from the
+    // receive thread instead of going through the mailbox.
+    obs_source_t            *async_output;
+};
+
+struct frame_manager_t {
+    std::string             pipe_name;
+    enum frame_receive_mode mode;
+    enum frame_transport    transport;
+    enum frame_pacing       pacing;
+    uint64_t                jitter_delay;   // ns
+    long                    jitter_frames;  // Due frames the delay covers.
+    bool                    straight_alpha;
+    bool                    gpu_convert;
+    enum pixel_convert_alpha premultiply;
+    obs_source_t            *async_output;
+    bool                    async_rects_warned;
+    bool                    async_format_warned;
+    bool                    audio_warned;
+    obs_pipe_subscriber_t   subscriber;
+    obs_pipe_raw_subscriber_t raw_subscriber;
+    bool                    paused;
+
+    // Scratch message for protobuf frames, only used by whichever thread
+    // parses (receive thread or video thread, depending on mode).
+    obs_pipe_frame_t        frame;
+
+    // FRAME_RECEIVE_CALLBACK: pixel buffers handed from the receive thread.
+    // Decode jobs publish too, so the producer side is serialized.
+    frame_mailbox_t         mailbox;
+    std::mutex              publish_mutex;
+    // Queue mode: the last publish did not fit, its frame is still in the
+    // write slot.
+    bool                    carry;
+
+    // Compressed frames, guarded by decode_mutex. decode_last_seq is
+    // guarded by publish_mutex. Jobs are ordered by submission, not by id,
+    // so a restarted publisher's lower ids are not taken for stale frames.
+    std::mutex              decode_mutex;
+    std::condition_variable decode_idle;
+    frame_decode_job_t      decode_jobs[FRAME_DECODE_JOBS];
+    frame_decode_job_t      decode_pending;
+    bool                    decode_has_pending;
+    uint64_t                decode_next_seq;
+    uint64_t                decode_last_seq;
+    long                    decode_dropped;
+
+    // Last keyframe, tight and unconverted (decoded for QOI_STRIPES), for
+    // the delta frames that follow it. Only used by whichever thread
+    // publishes.
+    uint8_t                 *key_pixels;
+    size_t                  key_capacity;
+    bool                    key_valid;
+    int64_t                 key_id;
+    uint32_t                key_format;
+    uint32_t                key_width;
+    uint32_t                key_height;
+    long                    delta_dropped;
+
+    // Async sources: converted frames, libobs copies them on output.
+    uint8_t                 *async_pixels;
+    size_t                  async_capacity;
+
+    // FRAME_RECEIVE_POLL: message received on the video thread, `poll_slot`
+    // points into it when no repacking is needed.
+    std::string             poll_buffer;
+    frame_slot_t            poll_slot;
+
+    // Video thread: more than one frame was ready at the last receive.
+    long                    last_dropped;
+    bool                    burst;
+};
+
+typedef frame_manager_t frame_manager_t;
+
+// ========================================================================== //
+// Functions
+// ========================================================================== //
+
+void frame_manager_open(
+    frame_manager_t                 *manager,
+    const frame_manager_config_t    *config
+);
+
+void frame_manager_close(frame_manager_t *manager);
+
+// Unsubscribes from the pipe while nobody shows it, so publishers see no
+// subscriber and eCAL stops buffering. Whatever is left in the mailbox is
+// kept. Both are no-ops when already in that state, and a paused manager
+// stays paused across frame_manager_open.
+void frame_manager_pause(frame_manager_t *manager);
+void frame_manager_resume(frame_manager_t *manager);
+
+// Called from the video thread. Returns the frame to show according to the
+// pacing policy, NULL if it should not change. The slot stays valid until
+// the next call.
+const frame_slot_t *frame_manager_receive(frame_manager_t *manager);
@@ -1,32 +1,82 @@
 #include "graphics-custom.h"
+#include "image-decoder.h"
+#include "pixel-pool.h"
 #include "plugin-support.h"
 
+#include <obs.h>
 #include <util/base.h>
 #include <util/bmem.h>
+#include <util/threading.h>
 
 //#define MAGICKCORE_QUANTUM_DEPTH    16
 //#define MAGICKCORE_HDRI_ENABLE      0
 
 #include <MagickCore/MagickCore.h>
 
-bool gs_custom_init_image_deps(void)
+// MagickCore is only a fallback decoder, its genesis is slow enough that it
+// is deferred until the first image actually needs it.
+static pthread_once_t   magick_once        = PTHREAD_ONCE_INIT;
+static bool             magick_initialized = false;
+
+static void gs_custom_magick_genesis(void)
 {
     MagickCoreGenesis(NULL, MagickTrue);
+    magick_initialized = true;
     obs_log(LOG_INFO, "initialized MagickCore (version: %s)", GetMagickVersion(NULL));
-    return true;
+}
+
+bool gs_custom_init_image_deps(void)
+{
+    pthread_once(&magick_once, gs_custom_magick_genesis);
+    return magick_initialized;
 }
 
 void gs_custom_free_image_deps(void)
 {
+    if (!magick_initialized) {
+        return;
+    }
+
     MagickCoreTerminus();
     obs_log(LOG_INFO, "deinitialized MagickCore");
 }
 
-// TODO: It would be best to use ffmpeg as obs.
+static gs_effect_t *convert_effect = NULL;
+
+bool gs_custom_init_effects(const char *convert_effect_path)
+{
+    char *error = NULL;
+
+    obs_enter_graphics();
+    convert_effect = gs_effect_create_from_file(convert_effect_path, &error);
+    obs_leave_graphics();
+
+    if (!convert_effect) {
+        obs_log(LOG_ERROR, "failed to load convert effect: %s", error ? error : "(unknown)");
+        bfree(error);
+        return false;
+    }
+
+    return true;
+}
+
+void gs_custom_free_effects(void)
+{
+    obs_enter_graphics();
+    gs_effect_destroy(convert_effect);
+    obs_leave_graphics();
+
+    convert_effect = NULL;
+}
+
+gs_effect_t *gs_custom_get_convert_effect(void)
+{
+    return convert_effect;
+}
+
 uint8_t *gs_get_pixel_data_from_buffer(
     const uint8_t               *buffer,
     size_t                      length,
-    enum gs_image_alpha_mode    alpha_mode,
     enum gs_color_format        *color_format,
     uint32_t                    *cx,
     uint32_t                    *cy,
@@ -47,6 +97,10 @@ uint8_t *gs_get_pixel_data_from_buffer(
         return NULL;
     }
 
+    if (!gs_custom_init_image_deps()) {
+        return NULL;
+    }
+
     info = CloneImageInfo(NULL);
     exception = AcquireExceptionInfo();
 
@@ -57,17 +111,13 @@ uint8_t *gs_get_pixel_data_from_buffer(
         size_t local_cy     = image->magick_rows;
         size_t required_len = local_cx * local_cy * 4;
 
-        // Use existing pixel data if available.
-        if (*pixel_data != NULL) {
-             if (*pixel_data_length >= required_len) {
-                 data = *pixel_data;
-             } else {
-                 bfree(*pixel_data);
-                 data = bmalloc(required_len);
-             }
-        } else {
-            data = bmalloc(required_len);
+        // Use existing pixel data if available. The buffer comes from the
+        // pixel pool and `*pixel_data_length` is its capacity.
+        if (*pixel_data == NULL || *pixel_data_length < required_len) {
+            pixel_pool_free(*pixel_data, *pixel_data_length);
+            *pixel_data = pixel_pool_alloc(required_len, pixel_data_length);
         }
+        data = *pixel_data;
 
         ExportImagePixels(image, 0, 0, local_cx, local_cy, "BGRA", CharPixel, data, exception);
         if (exception->severity != UndefinedException) {
@@ -76,13 +126,9 @@ uint8_t *gs_get_pixel_data_from_buffer(
                 "magickcore warning/error getting pixel data from buffer : %s",
                 exception->reason
             );
-            bfree(data);
             data = NULL;
         }
 
-        *pixel_data        = data;
-        *pixel_data_length = required_len;
-
         *color_format = GS_BGRA;
         *cx     = (uint32_t)local_cx;
         *cy     = (uint32_t)local_cy;
@@ -102,3 +148,47 @@ uint8_t *gs_get_pixel_data_from_buffer(
 
     return data;
 }
+
+// ========================================================================== //
+// MagickCore decoder backend
+// ========================================================================== //
+static bool magick_probe(const uint8_t *data, size_t size)
+{
+    UNUSED_PARAMETER(data);
+    UNUSED_PARAMETER(size);
+
+    // Fallback for whatever the other backends do not recognize.
+    return true;
+}
+
+static bool magick_decode(
+    void            *state,
+    const uint8_t   *data,
+    size_t          size,
+    uint8_t         **pixels,
+    size_t          *capacity,
+    uint32_t        *cx,
+    uint32_t        *cy
+) {
+    UNUSED_PARAMETER(state);
+
+    enum gs_color_format    format;
+    enum gs_color_space     space;
+
+    return gs_get_pixel_data_from_buffer(
+        data,
+        size,
+        &format,
+        cx,
+        cy,
+        &space,
+        pixels,
+        capacity
+    ) != NULL;
+}
+
+const struct image_decoder_backend image_decoder_magick = {
+    .name   = "magick",
+    .probe  = magick_probe,
+    .decode = magick_decode,
+};
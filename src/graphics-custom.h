@@ -10,10 +10,16 @@ extern "C" {
 bool gs_custom_init_image_deps(void);
 void gs_custom_free_image_deps(void);
 
+// Loads the plugin's conversion effect, must be called outside of graphics.
+bool gs_custom_init_effects(const char *convert_effect_path);
+void gs_custom_free_effects(void);
+gs_effect_t *gs_custom_get_convert_effect(void);
+
+// Decodes into `*pixel_data`, a pixel pool buffer of `*pixel_data_length`
+// bytes that is replaced when too small.
 uint8_t *gs_get_pixel_data_from_buffer(
     const uint8_t               *buffer,
     size_t                      length,
-    enum gs_image_alpha_mode    alpha_mode,
     enum gs_color_format        *color_format,
     uint32_t                    *cx,
     uint32_t                    *cy,
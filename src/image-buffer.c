@@ -18,10 +18,17 @@
 
 #include "image-buffer.h"
 #include "graphics-custom.h"
+#include "pixel-pool.h"
 #include "plugin-support.h"
 
+#include <obs.h>
+#include <graphics/vec2.h>
+#include <graphics/vec4.h>
 #include <util/base.h>
 
+// Largest texture size all graphics backends accept.
+#define GS_IMAGE_BUFFER_MAX_SIZE 16384
+
 static uint64_t calc_mem_usage(gs_image_buffer_t *image)
 {
     return image
@@ -30,6 +37,33 @@ static uint64_t calc_mem_usage(gs_image_buffer_t *image)
         ;
 }
 
+// Rounds up to an eighth of the highest power of two below `size`, but at
+// least to a multiple of 64. 1920 stays 1920, 1080 becomes 1152.
+static uint32_t gs_image_buffer_bucket(uint32_t size)
+{
+    uint32_t step = 64;
+    while (step * 16 <= size) {
+        step *= 2;
+    }
+
+    const uint32_t bucket = (size + step - 1) & ~(step - 1);
+    if (bucket > GS_IMAGE_BUFFER_MAX_SIZE) {
+        return size > GS_IMAGE_BUFFER_MAX_SIZE ? size : GS_IMAGE_BUFFER_MAX_SIZE;
+    }
+    return bucket;
+}
+
+// Whether the ring textures can hold the current frame. They are shrunk
+// once a frame no longer uses half of them in either direction.
+static bool gs_image_buffer_fits_capacity(const gs_image_buffer_t *image)
+{
+    return image->width  <= image->capacity_width
+        && image->height <= image->capacity_height
+        && gs_image_buffer_bucket(image->width)  > image->capacity_width / 2
+        && gs_image_buffer_bucket(image->height) > image->capacity_height / 2
+        ;
+}
+
 static void gs_image_buffer_init_internal(
     gs_image_buffer_t           *image,
     uint8_t                     *buffer,
@@ -38,8 +72,10 @@ static void gs_image_buffer_init_internal(
     bool                        is_raw,
     uint32_t                    width,
     uint32_t                    height,
+    const uint32_t              *linesize,
     enum gs_color_format        color_format,
-    enum gs_color_space         color_space
+    enum gs_color_space         color_space,
+    enum video_format           video_format
 ) {
     if (!image) {
         return;
@@ -56,13 +92,13 @@ static void gs_image_buffer_init_internal(
     uint32_t                prev_width  = image->width;
     uint32_t                prev_height = image->height;
     enum gs_color_format    prev_format = image->color_format;
+    enum video_format       prev_video  = image->video_format;
 
     if (!is_raw) {
         obs_log(LOG_DEBUG, "loading image from buffer");
         image->texture_data = gs_get_pixel_data_from_buffer(
             buffer,
             length,
-            alpha_mode,
             &image->color_format,
             &image->width,
             &image->height,
@@ -72,6 +108,7 @@ static void gs_image_buffer_init_internal(
         );
     } else {
         obs_log(LOG_DEBUG, "loading image using raw pixel data");
+        pixel_pool_free(image->internal_data_buf, image->internal_data_len);
         image->texture_data         = buffer;
         image->internal_data_buf    = NULL;
         image->internal_data_len    = 0;
@@ -81,13 +118,26 @@ static void gs_image_buffer_init_internal(
         image->color_space          = color_space;
     }
 
-    image->alpha_mode = alpha_mode;
-    image->mem_usage  = calc_mem_usage(image);
+    for (size_t i = 0; i < 3; i++) {
+        image->linesize[i] = is_raw && linesize ? linesize[i] : 0;
+    }
+
+    image->alpha_mode       = alpha_mode;
+    image->draw_alpha_mode  = is_raw ? alpha_mode : GS_IMAGE_ALPHA_STRAIGHT;
+    image->video_format     = is_raw ? video_format : VIDEO_FORMAT_NONE;
+    image->mem_usage    = calc_mem_usage(image);
+    image->rects        = NULL;
+    image->rect_count   = 0;
+
+    // RGB frames only need new textures when they outgrow the ring, the
+    // YUV planes are still sized exactly.
+    const bool resized = image->width != prev_width || image->height != prev_height;
 
     image->recreate_texture = !image->loaded
-        || image->width         != prev_width
-        || image->height        != prev_height
         || image->color_format  != prev_format
+        || image->video_format  != prev_video
+        || (image->video_format != VIDEO_FORMAT_NONE && resized)
+        || (image->video_format == VIDEO_FORMAT_NONE && !gs_image_buffer_fits_capacity(image))
         ;
 
     image->loaded = !!image->texture_data;
@@ -111,8 +161,10 @@ void gs_image_buffer_init(
         false,
         0,
         0,
+        NULL,
+        0,
         0,
-        0
+        VIDEO_FORMAT_NONE
     );
 }
 
@@ -122,10 +174,13 @@ void gs_image_buffer_init_from_raw_pixels(
     size_t                      length,
     uint32_t                    width,
     uint32_t                    height,
+    uint32_t                    linesize,
     enum gs_color_format        color_format,
     enum gs_image_alpha_mode    alpha_mode,
     enum gs_color_space         color_space
 ) {
+    const uint32_t linesizes[3] = {linesize, 0, 0};
+
     gs_image_buffer_init_internal(
         image,
         buffer,
@@ -134,11 +189,136 @@ void gs_image_buffer_init_from_raw_pixels(
         true,
         width,
         height,
+        linesizes,
         color_format,
-        color_space
+        color_space,
+        VIDEO_FORMAT_NONE
     );
 }
 
+void gs_image_buffer_init_from_yuv_planes(
+    gs_image_buffer_t           *image,
+    uint8_t                     *buffer,
+    size_t                      length,
+    uint32_t                    width,
+    uint32_t                    height,
+    const uint32_t              linesize[3],
+    enum video_format           video_format,
+    enum video_colorspace       colorspace,
+    enum video_range_type       range,
+    bool                        swap_rb
+) {
+    // PQ and HLG are converted to linear light, 1.0 being SDR white.
+    const bool hdr = colorspace == VIDEO_CS_2100_PQ || colorspace == VIDEO_CS_2100_HLG;
+
+    gs_image_buffer_init_internal(
+        image,
+        buffer,
+        length,
+        GS_IMAGE_ALPHA_STRAIGHT,
+        true,
+        width,
+        height,
+        linesize,
+        GS_BGRA,
+        hdr ? GS_CS_709_EXTENDED : GS_CS_SRGB,
+        video_format
+    );
+
+    if (image && image->loaded) {
+        image->video_colorspace = colorspace;
+        image->video_range      = range;
+        image->swap_rb          = swap_rb;
+    }
+}
+
+static void gs_image_buffer_destroy_textures(gs_image_buffer_t *image)
+{
+    for (size_t i = 0; i < GS_IMAGE_BUFFER_RING; i++) {
+        if (image->ring[i]) {
+            gs_texture_destroy(image->ring[i]);
+            image->ring[i] = NULL;
+        }
+    }
+
+    if (image->canvas) {
+        gs_texrender_destroy(image->canvas);
+        image->canvas = NULL;
+    }
+
+    if (image->patch) {
+        gs_texture_destroy(image->patch);
+        image->patch        = NULL;
+        image->patch_width  = 0;
+        image->patch_height = 0;
+    }
+
+    for (size_t i = 0; i < 3; i++) {
+        if (image->planes[i]) {
+            gs_texture_destroy(image->planes[i]);
+            image->planes[i] = NULL;
+        }
+    }
+
+    if (image->convert) {
+        gs_texrender_destroy(image->convert);
+        image->convert = NULL;
+    }
+
+    image->texture          = NULL;
+    image->ring_index       = 0;
+    image->capacity_width   = 0;
+    image->capacity_height  = 0;
+}
+
+bool gs_image_buffer_init_from_rects(
+    gs_image_buffer_t           *image,
+    uint8_t                     *tiles,
+    size_t                      length,
+    const struct gs_image_rect  *rects,
+    size_t                      rect_count,
+    uint32_t                    width,
+    uint32_t                    height,
+    enum gs_color_format        color_format
+) {
+    if (!image || !tiles || !rects) {
+        return false;
+    }
+
+    if (!image->loaded
+        || image->video_format  != VIDEO_FORMAT_NONE
+        || image->width         != width
+        || image->height        != height
+        || image->color_format  != color_format
+    ) {
+        obs_log(LOG_DEBUG, "skipping partial frame without a matching full frame");
+        return false;
+    }
+
+    const uint32_t bpp   = gs_get_format_bpp(color_format) / 8;
+    size_t         total = 0;
+
+    for (size_t i = 0; i < rect_count; i++) {
+        const struct gs_image_rect *rect = &rects[i];
+        if (rect->x + rect->width > width || rect->y + rect->height > height) {
+            obs_log(LOG_WARNING, "skipping partial frame with out of bounds rect");
+            return false;
+        }
+        total += (size_t)rect->width * rect->height * bpp;
+    }
+
+    if (total > length) {
+        obs_log(LOG_WARNING, "skipping truncated partial frame");
+        return false;
+    }
+
+    obs_log(LOG_DEBUG, "loading %zu dirty rects", rect_count);
+    image->texture_data = tiles;
+    image->rects        = rects;
+    image->rect_count   = rect_count;
+    return true;
+}
+
 void gs_image_buffer_free(gs_image_buffer_t *image)
 {
     if (!image) {
@@ -147,45 +327,520 @@ void gs_image_buffer_free(gs_image_buffer_t *image)
 
     obs_log(LOG_DEBUG, "freeing image buffer");
 
-    if (image->texture) {
-        gs_texture_destroy(image->texture);
+    gs_image_buffer_destroy_textures(image);
+
+    pixel_pool_free(image->internal_data_buf, image->internal_data_len);
+    pixel_pool_free(image->patch_data, image->patch_data_len);
+    pixel_pool_free(image->staging_data, image->staging_data_len);
+
+    memset(image, 0, sizeof(*image));
+}
+
+// Copies `rows` rows into a texture of `tex_rows` rows of `tex_row_size`
+// bytes. Linear filtering along the right and bottom edge of the image reads
+// one texel past it, so the last column and row are repeated into the padding
+// of a larger texture rather than leaving whatever was there.
+static void gs_image_buffer_copy_rows(
+    uint8_t                     *dst,
+    uint32_t                    linesize,
+    uint32_t                    tex_row_size,
+    uint32_t                    tex_rows,
+    const uint8_t               *data,
+    uint32_t                    row_size,
+    uint32_t                    pitch,
+    uint32_t                    rows,
+    uint32_t                    bpp
+) {
+    const bool pad_column = bpp > 0 && row_size >= bpp && row_size + bpp <= tex_row_size;
+    const bool pad_row    = rows > 0 && rows < tex_rows;
+
+    if (linesize == row_size && pitch == row_size) {
+        memcpy(dst, data, (size_t)row_size * rows);
+    } else {
+        for (uint32_t y = 0; y < rows; y++) {
+            memcpy(dst + (size_t)y * linesize, data + (size_t)y * pitch, row_size);
+        }
     }
 
-    if (image->internal_data_buf) {
-        bfree(image->internal_data_buf);
+    // From the source, reading back mapped texture memory is slow.
+    if (pad_column) {
+        for (uint32_t y = 0; y < rows; y++) {
+            memcpy(dst + (size_t)y * linesize + row_size, data + (size_t)y * pitch + row_size - bpp, bpp);
+        }
     }
 
-    memset(image, 0, sizeof(*image));
+    if (pad_row) {
+        const uint8_t *last = data + (size_t)(rows - 1) * pitch;
+        uint8_t       *row  = dst + (size_t)rows * linesize;
+
+        memcpy(row, last, row_size);
+        if (pad_column) {
+            memcpy(row + row_size, last + row_size - bpp, bpp);
+        }
+    }
 }
 
-void gs_image_buffer_init_texture(gs_image_buffer_t *image)
-{
-    if (!image->loaded) {
+// Copies straight into driver memory. Falls back to gs_texture_set_image if
+// the backend cannot map the texture. `rows` of `row_size` bytes, `pitch`
+// bytes apart in `data`, land in the top left corner of `texture`, which may
+// be larger.
+static void gs_image_buffer_upload(
+    gs_image_buffer_t           *image,
+    gs_texture_t                *texture,
+    const uint8_t               *data,
+    uint32_t                    row_size,
+    uint32_t                    pitch,
+    uint32_t                    rows
+) {
+    uint8_t     *ptr;
+    uint32_t    linesize;
+
+    const uint32_t bpp          = gs_get_format_bpp(gs_texture_get_color_format(texture)) / 8;
+    const uint32_t tex_rows     = gs_texture_get_height(texture);
+    const uint32_t tex_row_size = gs_texture_get_width(texture) * bpp;
+
+    if (image->map_failed || !gs_texture_map(texture, &ptr, &linesize)) {
+        if (!image->map_failed) {
+            obs_log(LOG_INFO, "texture mapping unavailable, using set_image uploads");
+            image->map_failed = true;
+        }
+
+        // set_image always writes the whole texture.
+        if (tex_row_size == row_size && tex_rows == rows) {
+            gs_texture_set_image(texture, data, pitch, false);
+            return;
+        }
+
+        const size_t size = (size_t)tex_row_size * tex_rows;
+        if (size > image->staging_data_len) {
+            pixel_pool_free(image->staging_data, image->staging_data_len);
+            image->staging_data = pixel_pool_alloc(size, &image->staging_data_len);
+        }
+
+        gs_image_buffer_copy_rows(image->staging_data, tex_row_size, tex_row_size, tex_rows, data, row_size, pitch, rows, bpp);
+        gs_texture_set_image(texture, image->staging_data, tex_row_size, false);
         return;
     }
 
+    gs_image_buffer_copy_rows(ptr, linesize, tex_row_size, tex_rows, data, row_size, pitch, rows, bpp);
+    gs_texture_unmap(texture);
+}
+
+struct gs_image_plane {
+    uint32_t                    width;
+    uint32_t                    height;
+    enum gs_color_format        format;
+};
+
+// Plane textures of a frame converted on the GPU, returns their count.
+static size_t gs_image_buffer_get_planes(const gs_image_buffer_t *image, struct gs_image_plane planes[3])
+{
+    const uint32_t cx = image->width;
+    const uint32_t cy = image->height;
+
+    switch (image->video_format) {
+    case VIDEO_FORMAT_NV12:
+        planes[0] = (struct gs_image_plane){cx,     cy,     GS_R8};
+        planes[1] = (struct gs_image_plane){cx / 2, cy / 2, GS_R8G8};
+        return 2;
+    case VIDEO_FORMAT_P010:
+        planes[0] = (struct gs_image_plane){cx,     cy,     GS_R16};
+        planes[1] = (struct gs_image_plane){cx / 2, cy / 2, GS_RG16};
+        return 2;
+    case VIDEO_FORMAT_I420:
+        planes[0] = (struct gs_image_plane){cx,     cy,     GS_R8};
+        planes[1] = (struct gs_image_plane){cx / 2, cy / 2, GS_R8};
+        planes[2] = planes[1];
+        return 3;
+    case VIDEO_FORMAT_BGR3:
+        planes[0] = (struct gs_image_plane){cx * 3, cy,     GS_R8};
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static const char *gs_image_buffer_get_technique(const gs_image_buffer_t *image)
+{
+    switch (image->video_format) {
+    case VIDEO_FORMAT_NV12: return "NV12";
+    case VIDEO_FORMAT_I420: return "I420";
+    case VIDEO_FORMAT_BGR3: return image->swap_rb ? "RGB3" : "BGR3";
+    case VIDEO_FORMAT_P010:
+        // Normalized 16-bit samples, the matrix takes care of the scale.
+        return image->video_colorspace == VIDEO_CS_2100_PQ  ? "P010_PQ"
+             : image->video_colorspace == VIDEO_CS_2100_HLG ? "P010_HLG"
+             : "NV12";
+    default:                return NULL;
+    }
+}
+
+static void gs_image_buffer_upload_yuv(gs_image_buffer_t *image)
+{
+    struct gs_image_plane planes[3];
+
+    const size_t   count  = gs_image_buffer_get_planes(image, planes);
+    const bool     yuv    = image->video_format != VIDEO_FORMAT_BGR3;
+    const bool     hdr    = image->color_space != GS_CS_SRGB;
+    const uint32_t cx     = image->width;
+    const uint32_t cy     = image->height;
+
     if (image->recreate_texture) {
-        if (image->texture) {
-            obs_log(LOG_DEBUG, "destroying texture");
-            gs_texture_destroy(image->texture);
+        obs_log(LOG_DEBUG, "creating plane textures");
+        gs_image_buffer_destroy_textures(image);
+
+        for (size_t i = 0; i < count; i++) {
+            image->planes[i] = gs_texture_create(planes[i].width, planes[i].height, planes[i].format, 1, NULL, GS_DYNAMIC);
         }
 
-        obs_log(LOG_DEBUG, "creating texture");
-        image->texture = gs_texture_create(
-            image->width,
-            image->height,
+        image->recreate_texture = false;
+    }
+
+    // HDR output does not fit 8 bits, the planes themselves stay.
+    const enum gs_color_format convert_format = hdr ? GS_RGBA16F : GS_BGRA;
+    if (image->convert && image->convert_format != convert_format) {
+        gs_texrender_destroy(image->convert);
+        image->convert = NULL;
+    }
+    if (!image->convert) {
+        image->convert        = gs_texrender_create(convert_format, GS_ZS_NONE);
+        image->convert_format = convert_format;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!image->planes[i]) {
+            obs_log(LOG_ERROR, "failed to create plane texture");
+            return;
+        }
+    }
+
+    // Planes are back to back: Y, then UV or U and V.
+    const uint8_t *data = image->texture_data;
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t row_size = planes[i].width * gs_get_format_bpp(planes[i].format) / 8;
+        const uint32_t pitch    = image->linesize[i] ? image->linesize[i] : row_size;
+        gs_image_buffer_upload(image, image->planes[i], data, row_size, pitch, planes[i].height);
+        data += (size_t)pitch * planes[i].height;
+    }
+
+    gs_effect_t *const effect = gs_custom_get_convert_effect();
+    if (!effect) {
+        return;
+    }
+
+    float       matrix[16];
+    float       range_min[3];
+    float       range_max[3];
+    struct vec4 vec;
+    struct vec2 size;
+
+    if (yuv) {
+        video_format_get_parameters_for_format(
+            image->video_colorspace,
+            image->video_range,
+            image->video_format,
+            matrix,
+            range_min,
+            range_max
+        );
+    }
+
+    gs_texrender_reset(image->convert);
+    if (!gs_texrender_begin(image->convert, cx, cy)) {
+        obs_log(LOG_ERROR, "failed to render yuv conversion");
+        return;
+    }
+
+    const bool previous = gs_framebuffer_srgb_enabled();
+    gs_enable_framebuffer_srgb(false);
+
+    gs_blend_state_push();
+    gs_enable_blending(false);
+    gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+    gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),  image->planes[0]);
+    gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image1"), image->planes[1]);
+    gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image2"), image->planes[2]);
+
+    if (yuv) {
+        vec4_set(&vec, matrix[0], matrix[1], matrix[2], matrix[3]);
+        gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec0"), &vec);
+        vec4_set(&vec, matrix[4], matrix[5], matrix[6], matrix[7]);
+        gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec1"), &vec);
+        vec4_set(&vec, matrix[8], matrix[9], matrix[10], matrix[11]);
+        gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec2"), &vec);
+        gs_effect_set_val(gs_effect_get_param_by_name(effect, "color_range_min"), range_min, sizeof(range_min));
+        gs_effect_set_val(gs_effect_get_param_by_name(effect, "color_range_max"), range_max, sizeof(range_max));
+
+        // PQ is absolute up to 10000 nits, HLG relative to a 1000 nit peak.
+        if (hdr) {
+            const float nits = image->video_colorspace == VIDEO_CS_2100_PQ ? 10000.0f : 1000.0f;
+            gs_effect_set_float(gs_effect_get_param_by_name(effect, "hdr_multiplier"), nits / obs_get_video_sdr_white_level());
+            gs_effect_set_float(gs_effect_get_param_by_name(effect, "hlg_exponent"), 0.2f);
+        }
+    } else {
+        vec2_set(&size, (float)cx, (float)cy);
+        gs_effect_set_vec2(gs_effect_get_param_by_name(effect, "frame_size"), &size);
+    }
+
+    while (gs_effect_loop(effect, gs_image_buffer_get_technique(image))) {
+        gs_draw_sprite(image->planes[0], 0, cx, cy);
+    }
+
+    gs_blend_state_pop();
+    gs_enable_framebuffer_srgb(previous);
+
+    gs_texrender_end(image->convert);
+    image->texture = gs_texrender_get_texture(image->convert);
+}
+
+// Draws `base` (if any) and then every tile from the patch atlas into the
+// canvas. The atlas stacks the tiles vertically, in rect order.
+static void gs_image_buffer_render_canvas(gs_image_buffer_t *image, gs_texture_t *base, bool patches)
+{
+    gs_effect_t *const effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+    gs_eparam_t *const param  = gs_effect_get_param_by_name(effect, "image");
+
+    if (!image->canvas) {
+        image->canvas = gs_texrender_create(image->color_format, GS_ZS_NONE);
+    }
+
+    gs_texrender_reset(image->canvas);
+    if (!gs_texrender_begin(image->canvas, image->width, image->height)) {
+        obs_log(LOG_ERROR, "failed to render image canvas");
+        return;
+    }
+
+    const bool previous = gs_framebuffer_srgb_enabled();
+    gs_enable_framebuffer_srgb(false);
+
+    gs_blend_state_push();
+    gs_enable_blending(false);
+    gs_ortho(0.0f, (float)image->width, 0.0f, (float)image->height, -100.0f, 100.0f);
+
+    if (base) {
+        gs_effect_set_texture(param, base);
+        while (gs_effect_loop(effect, "Draw")) {
+            gs_draw_sprite_subregion(base, 0, 0, 0, image->width, image->height);
+        }
+    }
+
+    if (patches) {
+        uint32_t atlas_y = 0;
+
+        for (size_t i = 0; i < image->rect_count; i++) {
+            const struct gs_image_rect *rect = &image->rects[i];
+
+            gs_matrix_push();
+            gs_matrix_translate3f((float)rect->x, (float)rect->y, 0.0f);
+
+            gs_effect_set_texture(param, image->patch);
+            while (gs_effect_loop(effect, "Draw")) {
+                gs_draw_sprite_subregion(image->patch, 0, 0, atlas_y, rect->width, rect->height);
+            }
+
+            gs_matrix_pop();
+            atlas_y += rect->height;
+        }
+    }
+
+    gs_blend_state_pop();
+    gs_enable_framebuffer_srgb(previous);
+
+    gs_texrender_end(image->canvas);
+    image->texture = gs_texrender_get_texture(image->canvas);
+}
+
+static void gs_image_buffer_upload_rects(gs_image_buffer_t *image)
+{
+    const uint32_t bpp = gs_get_format_bpp(image->color_format) / 8;
+
+    uint32_t atlas_width  = 0;
+    uint32_t atlas_height = 0;
+    for (size_t i = 0; i < image->rect_count; i++) {
+        atlas_width   = image->rects[i].width > atlas_width ? image->rects[i].width : atlas_width;
+        atlas_height += image->rects[i].height;
+    }
+
+    if (atlas_width == 0 || atlas_height == 0) {
+        return;
+    }
+
+    // Grow the atlas in steps, the tile layout usually varies per frame.
+    if (atlas_width > image->patch_width || atlas_height > image->patch_height) {
+        if (image->patch) {
+            gs_texture_destroy(image->patch);
+        }
+
+        image->patch_width  = (atlas_width  + 63) & ~63u;
+        image->patch_height = (atlas_height + 63) & ~63u;
+        image->patch = gs_texture_create(
+            image->patch_width,
+            image->patch_height,
             image->color_format,
             1,
-            (const uint8_t **)&image->texture_data,
+            NULL,
             GS_DYNAMIC
         );
-        image->recreate_texture = false;
+
+        pixel_pool_free(image->patch_data, image->patch_data_len);
+        image->patch_data     = NULL;
+        image->patch_data_len = 0;
+    }
+
+    if (!image->patch) {
+        obs_log(LOG_ERROR, "failed to create patch texture");
+        return;
+    }
+
+    uint8_t     *ptr;
+    uint32_t    linesize;
+    const bool  mapped = !image->map_failed && gs_texture_map(image->patch, &ptr, &linesize);
+
+    if (!mapped) {
+        linesize = image->patch_width * bpp;
+        if (!image->patch_data) {
+            image->patch_data = pixel_pool_alloc((size_t)linesize * image->patch_height, &image->patch_data_len);
+        }
+        ptr = image->patch_data;
+    }
+
+    const uint8_t *tile = image->texture_data;
+    for (size_t i = 0; i < image->rect_count; i++) {
+        const struct gs_image_rect *rect = &image->rects[i];
+        const size_t row_size = (size_t)rect->width * bpp;
+
+        for (uint32_t y = 0; y < rect->height; y++) {
+            memcpy(ptr, tile, row_size);
+            ptr  += linesize;
+            tile += row_size;
+        }
+    }
+
+    if (mapped) {
+        gs_texture_unmap(image->patch);
     } else {
-        gs_texture_set_image(image->texture, image->texture_data, image->width * 4, false);
+        gs_texture_set_image(image->patch, image->patch_data, linesize, false);
     }
 
-    if (!image->texture) {
+    // The first partial frame seeds the canvas from the last full upload.
+    gs_image_buffer_render_canvas(image, image->canvas ? NULL : image->texture, true);
+}
+
+void gs_image_buffer_init_texture(gs_image_buffer_t *image)
+{
+    if (!image->loaded || !image->texture_data) {
+        return;
+    }
+
+    if (image->video_format != VIDEO_FORMAT_NONE) {
+        gs_image_buffer_upload_yuv(image);
+        return;
+    }
+
+    if (image->rect_count > 0 && !image->recreate_texture) {
+        gs_image_buffer_upload_rects(image);
+        image->rect_count = 0;
+        return;
+    }
+
+    if (image->recreate_texture) {
+        gs_image_buffer_destroy_textures(image);
+
+        image->capacity_width  = gs_image_buffer_bucket(image->width);
+        image->capacity_height = gs_image_buffer_bucket(image->height);
+        obs_log(
+            LOG_DEBUG,
+            "creating %ux%u texture ring for %ux%u frames",
+            image->capacity_width,
+            image->capacity_height,
+            image->width,
+            image->height
+        );
+
+        for (size_t i = 0; i < GS_IMAGE_BUFFER_RING; i++) {
+            image->ring[i] = gs_texture_create(
+                image->capacity_width,
+                image->capacity_height,
+                image->color_format,
+                1,
+                NULL,
+                GS_DYNAMIC
+            );
+        }
+
+        // The first upload below goes to ring[0].
+        image->ring_index       = GS_IMAGE_BUFFER_RING - 1;
+        image->recreate_texture = false;
+    }
+
+    const uint32_t next    = (image->ring_index + 1) % GS_IMAGE_BUFFER_RING;
+    gs_texture_t  *texture = image->ring[next];
+
+    if (!texture) {
         obs_log(LOG_ERROR, "failed to create texture");
+        return;
+    }
+
+    const uint32_t row_size = image->width * gs_get_format_bpp(image->color_format) / 8;
+    const uint32_t pitch    = image->linesize[0] ? image->linesize[0] : row_size;
+    gs_image_buffer_upload(image, texture, image->texture_data, row_size, pitch, image->height);
+
+    // Only now is the texture complete, render switches to it.
+    image->texture    = texture;
+    image->ring_index = next;
+
+    // Keep composing into the canvas once partial frames were seen.
+    if (image->canvas) {
+        gs_image_buffer_render_canvas(image, texture, false);
+    }
+}
+
+void gs_image_buffer_release_data(gs_image_buffer_t *image)
+{
+    // Decoded images own their pixels, raw ones only borrow them.
+    if (image->internal_data_buf) {
+        return;
+    }
+
+    image->texture_data = NULL;
+    image->rects        = NULL;
+    image->rect_count   = 0;
+}
+
+void gs_image_buffer_draw(gs_image_buffer_t *image)
+{
+    if (!image->texture) {
+        return;
+    }
+
+    gs_effect_t *effect    = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+    const char  *technique = "Draw";
+
+    // Linear colour spaces have nothing to decode before premultiplying.
+    const bool linear = image->color_space == GS_CS_709_EXTENDED || image->color_space == GS_CS_709_SCRGB;
+
+    // GS_R10G10B10A2 has no sRGB view, sRGB frames in it are sampled as
+    // stored and decoded by the shader.
+    const bool decode = image->color_space == GS_CS_SRGB && image->color_format == GS_R10G10B10A2;
+
+    gs_effect_t *const convert = gs_custom_get_convert_effect();
+    if (convert && decode) {
+        effect    = convert;
+        technique = image->draw_alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB ? "DrawSrgbDecodePremultiplyLinear"
+                  : image->draw_alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY      ? "DrawSrgbDecodePremultiply"
+                  : "DrawSrgbDecode";
+    } else if (convert && image->draw_alpha_mode != GS_IMAGE_ALPHA_STRAIGHT) {
+        effect    = convert;
+        technique = linear || image->draw_alpha_mode == GS_IMAGE_ALPHA_PREMULTIPLY_SRGB
+            ? "DrawPremultiplyLinear"
+            : "DrawPremultiply";
+    }
+
+    gs_effect_set_texture_srgb(gs_effect_get_param_by_name(effect, "image"), image->texture);
+
+    while (gs_effect_loop(effect, technique)) {
+        gs_draw_sprite_subregion(image->texture, 0, 0, 0, image->width, image->height);
     }
 }
 
@@ -19,25 +19,83 @@
 #pragma once
 
 #include <graphics/graphics.h>
+#include <media-io/video-io.h>
 #include <util/base.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Number of dynamic textures uploads rotate through, so the upload of frame
+// N+1 never targets the texture frame N is being drawn from.
+#define GS_IMAGE_BUFFER_RING 3
+
+struct gs_image_rect {
+    uint32_t                    x;
+    uint32_t                    y;
+    uint32_t                    width;
+    uint32_t                    height;
+};
+
 struct gs_image_buffer {
-    gs_texture_t                *texture;
+    gs_texture_t                *texture;       // Last fully uploaded texture.
+    gs_texture_t                *ring[GS_IMAGE_BUFFER_RING];
+    uint32_t                    ring_index;
+    bool                        map_failed;
     uint8_t                     *texture_data;
     uint32_t                    width;
     uint32_t                    height;
+
+    // Row pitch of each plane in `texture_data`, zero when tightly packed.
+    // Raw frames only, padded publisher buffers are uploaded without
+    // repacking them first.
+    uint32_t                    linesize[3];
+
+    // Size the ring textures were created with. It is rounded up so frames
+    // that change size slightly reuse them, only the top left `width` x
+    // `height` region is valid. Draw with gs_image_buffer_draw.
+    uint32_t                    capacity_width;
+    uint32_t                    capacity_height;
+    uint8_t                     *staging_data;  // set_image fallback only.
+    size_t                      staging_data_len;
+
     enum gs_color_format        color_format;
     enum gs_image_alpha_mode    alpha_mode;
     enum gs_color_space         color_space;
+
+    // Raw frames with straight alpha are premultiplied while drawing.
+    // GS_IMAGE_ALPHA_STRAIGHT, libobs' "leave as is", when nothing is left
+    // to do.
+    enum gs_image_alpha_mode    draw_alpha_mode;
     bool                        loaded;
     bool                        recreate_texture;
     uint8_t                     *internal_data_buf;
     size_t                      internal_data_len;
     uint64_t                    mem_usage;
+
+    // Partial updates. `texture_data` then holds one packed tile per rect.
+    // Once the first one arrives, frames are composed into `canvas` on the
+    // GPU so only the tiles have to be uploaded.
+    const struct gs_image_rect  *rects;
+    size_t                      rect_count;
+    gs_texrender_t              *canvas;
+    gs_texture_t                *patch;
+    uint32_t                    patch_width;
+    uint32_t                    patch_height;
+    uint8_t                     *patch_data;
+    size_t                      patch_data_len;
+
+    // Planar YUV and packed 24-bit BGR3 frames (VIDEO_FORMAT_NONE
+    // otherwise). Each plane gets its own texture and `convert` holds the
+    // RGB result drawn by the source. `swap_rb` reads BGR3 as RGB. PQ and
+    // HLG frames convert into a half float `convert`.
+    enum video_format           video_format;
+    enum video_colorspace       video_colorspace;
+    enum video_range_type       video_range;
+    bool                        swap_rb;
+    gs_texture_t                *planes[3];
+    gs_texrender_t              *convert;
+    enum gs_color_format        convert_format;
 };
 
 typedef struct gs_image_buffer gs_image_buffer_t;
@@ -49,20 +107,61 @@ void gs_image_buffer_init(
     enum gs_image_alpha_mode    alpha_mode
 );
 
+// A zero `linesize` means tightly packed rows.
 void gs_image_buffer_init_from_raw_pixels(
     gs_image_buffer_t           *image,
     uint8_t                     *buffer,
     size_t                      length,
     uint32_t                    width,
     uint32_t                    height,
+    uint32_t                    linesize,
     enum gs_color_format        color_format,
     enum gs_image_alpha_mode    alpha_mode,
     enum gs_color_space         color_space
 );
 
+// `buffer` holds the planes of an NV12, P010 or I420 frame back to back, or
+// the rows of a BGR3 frame. They are converted on the GPU. `linesize` may be
+// NULL, or zero per plane, for tightly packed rows.
+void gs_image_buffer_init_from_yuv_planes(
+    gs_image_buffer_t           *image,
+    uint8_t                     *buffer,
+    size_t                      length,
+    uint32_t                    width,
+    uint32_t                    height,
+    const uint32_t              linesize[3],
+    enum video_format           video_format,
+    enum video_colorspace       colorspace,
+    enum video_range_type       range,
+    bool                        swap_rb
+);
+
+// Patches the loaded image with the given tiles. Returns false, leaving the
+// image as it was, unless a full frame of the same size and format was loaded
+// before and the tiles fit in it.
+bool gs_image_buffer_init_from_rects(
+    gs_image_buffer_t           *image,
+    uint8_t                     *tiles,
+    size_t                      length,
+    const struct gs_image_rect  *rects,
+    size_t                      rect_count,
+    uint32_t                    width,
+    uint32_t                    height,
+    enum gs_color_format        color_format
+);
+
 void gs_image_buffer_init_texture(gs_image_buffer_t *image);
+
+// Drops the pointers to raw pixels and rects once they are uploaded, for
+// callers that hand the buffer back. The next upload needs a new init.
+void gs_image_buffer_release_data(gs_image_buffer_t *image);
 void gs_image_buffer_free(gs_image_buffer_t *image);
 
+// Draws the valid region of the current texture, premultiplying it on the
+// way if `draw_alpha_mode` asks for it. Runs its own effect, the caller
+// only sets up blending and sRGB.
+void gs_image_buffer_draw(gs_image_buffer_t *image);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,173 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "image-decoder.h"
+#include "plugin-support.h"
+
+#include <util/base.h>
+#include <util/bmem.h>
+
+#include <limits.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+
+// ========================================================================== //
+// PNG and JPEG through libavcodec, the same decoders OBS uses for image files.
+// ========================================================================== //
+
+struct ffmpeg_decoder {
+    AVCodecContext              *png;
+    AVCodecContext              *jpeg;
+    AVPacket                    *packet;
+    AVFrame                     *frame;
+    struct SwsContext           *sws;
+};
+
+static bool ffmpeg_is_png(const uint8_t *data, size_t size)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    return size >= sizeof(signature) && memcmp(data, signature, sizeof(signature)) == 0;
+}
+
+static bool ffmpeg_is_jpeg(const uint8_t *data, size_t size)
+{
+    return size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff;
+}
+
+static bool ffmpeg_probe(const uint8_t *data, size_t size)
+{
+    return ffmpeg_is_png(data, size) || ffmpeg_is_jpeg(data, size);
+}
+
+static void *ffmpeg_create(void)
+{
+    struct ffmpeg_decoder *decoder = bzalloc(sizeof(struct ffmpeg_decoder));
+    decoder->packet = av_packet_alloc();
+    decoder->frame  = av_frame_alloc();
+    return decoder;
+}
+
+static void ffmpeg_destroy(void *state)
+{
+    struct ffmpeg_decoder *decoder = state;
+
+    avcodec_free_context(&decoder->png);
+    avcodec_free_context(&decoder->jpeg);
+    av_packet_free(&decoder->packet);
+    av_frame_free(&decoder->frame);
+    sws_freeContext(decoder->sws);
+    bfree(decoder);
+}
+
+static AVCodecContext *ffmpeg_open_codec(AVCodecContext **context, enum AVCodecID id)
+{
+    if (*context) {
+        return *context;
+    }
+
+    const AVCodec *codec = avcodec_find_decoder(id);
+    if (!codec) {
+        obs_log(LOG_WARNING, "ffmpeg decoder: %s not available", avcodec_get_name(id));
+        return NULL;
+    }
+
+    *context = avcodec_alloc_context3(codec);
+    if (!*context || avcodec_open2(*context, codec, NULL) < 0) {
+        obs_log(LOG_WARNING, "ffmpeg decoder: failed to open %s", codec->name);
+        avcodec_free_context(context);
+        return NULL;
+    }
+
+    return *context;
+}
+
+static bool ffmpeg_decode(
+    void            *state,
+    const uint8_t   *data,
+    size_t          size,
+    uint8_t         **pixels,
+    size_t          *capacity,
+    uint32_t        *cx,
+    uint32_t        *cy
+) {
+    struct ffmpeg_decoder   *decoder = state;
+    AVCodecContext          *context = ffmpeg_is_png(data, size)
+        ? ffmpeg_open_codec(&decoder->png,  AV_CODEC_ID_PNG)
+        : ffmpeg_open_codec(&decoder->jpeg, AV_CODEC_ID_MJPEG);
+
+    if (!context || !decoder->packet || !decoder->frame || size > INT_MAX) {
+        return false;
+    }
+
+    // The packet only borrows the payload, both decoders are intra-only so
+    // the frame comes back from the same packet.
+    decoder->packet->data = (uint8_t *)data;
+    decoder->packet->size = (int)size;
+
+    int ret = avcodec_send_packet(context, decoder->packet);
+    if (ret >= 0) {
+        ret = avcodec_receive_frame(context, decoder->frame);
+    }
+    av_packet_unref(decoder->packet);
+
+    if (ret < 0) {
+        avcodec_flush_buffers(context);
+        return false;
+    }
+
+    AVFrame     *frame  = decoder->frame;
+    const int   width   = frame->width;
+    const int   height  = frame->height;
+
+    decoder->sws = sws_getCachedContext(
+        decoder->sws,
+        width, height, (enum AVPixelFormat)frame->format,
+        width, height, AV_PIX_FMT_BGRA,
+        SWS_POINT, NULL, NULL, NULL
+    );
+
+    bool ok = false;
+    if (decoder->sws) {
+        uint8_t     *dst[4]         = {image_decoder_reserve(pixels, capacity, (size_t)width * height * 4)};
+        const int   dst_linesize[4] = {width * 4};
+
+        ok = sws_scale(
+            decoder->sws,
+            (const uint8_t *const *)frame->data, frame->linesize,
+            0, height,
+            dst, dst_linesize
+        ) == height;
+
+        *cx = (uint32_t)width;
+        *cy = (uint32_t)height;
+    }
+
+    av_frame_unref(frame);
+    return ok;
+}
+
+const struct image_decoder_backend image_decoder_ffmpeg = {
+    .name    = "ffmpeg",
+    .probe   = ffmpeg_probe,
+    .create  = ffmpeg_create,
+    .destroy = ffmpeg_destroy,
+    .decode  = ffmpeg_decode,
+};
@@ -0,0 +1,162 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "image-decoder.h"
+
+#include <string.h>
+
+// ========================================================================== //
+// QOI - https://qoiformat.org/qoi-specification.pdf
+// ========================================================================== //
+
+#define QOI_HEADER_SIZE     14
+#define QOI_PADDING         8
+#define QOI_MAX_PIXELS      400000000u
+#define QOI_MAX_RUN         62
+
+#define QOI_OP_INDEX        0x00
+#define QOI_OP_DIFF         0x40
+#define QOI_OP_LUMA         0x80
+#define QOI_OP_RUN          0xc0
+#define QOI_OP_RGB          0xfe
+#define QOI_OP_RGBA         0xff
+#define QOI_MASK_2          0xc0
+
+struct qoi_rgba {
+    uint8_t                     r;
+    uint8_t                     g;
+    uint8_t                     b;
+    uint8_t                     a;
+};
+
+static inline uint32_t qoi_read_be32(const uint8_t *data)
+{
+    return (uint32_t)data[0] << 24
+        | (uint32_t)data[1] << 16
+        | (uint32_t)data[2] << 8
+        | (uint32_t)data[3];
+}
+
+static inline size_t qoi_hash(struct qoi_rgba px)
+{
+    return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+static bool qoi_probe(const uint8_t *data, size_t size)
+{
+    return size >= QOI_HEADER_SIZE + QOI_PADDING && memcmp(data, "qoif", 4) == 0;
+}
+
+static bool qoi_decode(
+    void            *state,
+    const uint8_t   *data,
+    size_t          size,
+    uint8_t         **pixels,
+    size_t          *capacity,
+    uint32_t        *cx,
+    uint32_t        *cy
+) {
+    UNUSED_PARAMETER(state);
+
+    const uint32_t  width    = qoi_read_be32(data + 4);
+    const uint32_t  height   = qoi_read_be32(data + 8);
+    const uint8_t   channels = data[12];
+
+    if (width == 0 || height == 0 || channels < 3 || channels > 4) {
+        return false;
+    }
+    if ((uint64_t)width * height > QOI_MAX_PIXELS) {
+        return false;
+    }
+
+    // No chunk byte yields more than a full run of pixels, a header claiming
+    // more than the payload can hold must not size the allocation.
+    if ((uint64_t)width * height > (uint64_t)(size - QOI_HEADER_SIZE - QOI_PADDING) * QOI_MAX_RUN) {
+        return false;
+    }
+
+    const size_t    out_size   = (size_t)width * height * 4;
+    const size_t    chunks_end = size - QOI_PADDING;
+    uint8_t         *out       = image_decoder_reserve(pixels, capacity, out_size);
+
+    struct qoi_rgba index[64];
+    struct qoi_rgba px  = {0, 0, 0, 255};
+    size_t          p   = QOI_HEADER_SIZE;
+    uint32_t        run = 0;
+
+    memset(index, 0, sizeof(index));
+
+    for (size_t i = 0; i < out_size; i += 4) {
+        if (run > 0) {
+            run--;
+        } else if (p < chunks_end) {
+            const uint8_t b1 = data[p++];
+
+            if (b1 == QOI_OP_RGB) {
+                if (p + 3 > chunks_end) {
+                    return false;
+                }
+                px.r = data[p++];
+                px.g = data[p++];
+                px.b = data[p++];
+            } else if (b1 == QOI_OP_RGBA) {
+                if (p + 4 > chunks_end) {
+                    return false;
+                }
+                px.r = data[p++];
+                px.g = data[p++];
+                px.b = data[p++];
+                px.a = data[p++];
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+                px = index[b1];
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+                px.r += ((b1 >> 4) & 0x03) - 2;
+                px.g += ((b1 >> 2) & 0x03) - 2;
+                px.b += ( b1       & 0x03) - 2;
+            } else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+                if (p + 1 > chunks_end) {
+                    return false;
+                }
+                const uint8_t   b2 = data[p++];
+                const int       vg = (b1 & 0x3f) - 32;
+                px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+                px.g += vg;
+                px.b += vg - 8 +  (b2       & 0x0f);
+            } else {
+                run = b1 & 0x3f;
+            }
+
+            index[qoi_hash(px)] = px;
+        }
+
+        out[i + 0] = px.b;
+        out[i + 1] = px.g;
+        out[i + 2] = px.r;
+        out[i + 3] = px.a;
+    }
+
+    *cx = width;
+    *cy = height;
+    return true;
+}
+
+const struct image_decoder_backend image_decoder_qoi = {
+    .name   = "qoi",
+    .probe  = qoi_probe,
+    .decode = qoi_decode,
+};
@@ -0,0 +1,104 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "image-decoder.h"
+#include "pixel-pool.h"
+#include "plugin-support.h"
+
+#include <util/base.h>
+#include <util/bmem.h>
+
+static const struct image_decoder_backend *const backends[] = {
+    &image_decoder_qoi,
+#ifdef HAVE_FFMPEG_DECODER
+    &image_decoder_ffmpeg,
+#endif
+    &image_decoder_magick,
+};
+
+#define BACKEND_COUNT (sizeof(backends) / sizeof(backends[0]))
+
+struct image_decoder {
+    void                        *states[BACKEND_COUNT];
+    bool                        created[BACKEND_COUNT];
+};
+
+image_decoder_t *image_decoder_create(void)
+{
+    return bzalloc(sizeof(image_decoder_t));
+}
+
+void image_decoder_destroy(image_decoder_t *decoder)
+{
+    if (!decoder) {
+        return;
+    }
+
+    for (size_t i = 0; i < BACKEND_COUNT; i++) {
+        if (decoder->created[i] && backends[i]->destroy) {
+            backends[i]->destroy(decoder->states[i]);
+        }
+    }
+
+    bfree(decoder);
+}
+
+uint8_t *image_decoder_decode(
+    image_decoder_t     *decoder,
+    const uint8_t       *data,
+    size_t              size,
+    uint8_t             **pixels,
+    size_t              *capacity,
+    uint32_t            *cx,
+    uint32_t            *cy
+) {
+    if (!decoder || !data || size == 0) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < BACKEND_COUNT; i++) {
+        const struct image_decoder_backend *backend = backends[i];
+
+        if (!backend->probe(data, size)) {
+            continue;
+        }
+
+        if (!decoder->created[i]) {
+            decoder->states[i]  = backend->create ? backend->create() : NULL;
+            decoder->created[i] = true;
+        }
+
+        if (backend->decode(decoder->states[i], data, size, pixels, capacity, cx, cy)) {
+            return *pixels;
+        }
+
+        obs_log(LOG_DEBUG, "%s decoder failed, trying next backend", backend->name);
+    }
+
+    return NULL;
+}
+
+uint8_t *image_decoder_reserve(uint8_t **pixels, size_t *capacity, size_t size)
+{
+    if (!*pixels || *capacity < size) {
+        pixel_pool_free(*pixels, *capacity);
+        *pixels = pixel_pool_alloc(size, capacity);
+    }
+
+    return *pixels;
+}
@@ -0,0 +1,91 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================================================== //
+// Image decoder
+//
+// Decodes compressed frame payloads to BGRA with straight alpha. Backends are
+// tried in order, the first one whose probe() accepts the payload decodes it:
+//
+//   qoi     - built-in, no dependencies
+//   ffmpeg  - PNG and JPEG through libavcodec (HAVE_FFMPEG_DECODER)
+//   magick  - MagickCore, accepts anything, initialized on first use
+//
+// A decoder keeps per-backend state (codec contexts, scalers) and is not
+// thread-safe, use one per thread or job.
+// ========================================================================== //
+
+struct image_decoder_backend {
+    const char  *name;
+
+    // Cheap check of the payload's signature.
+    bool        (*probe)(const uint8_t *data, size_t size);
+
+    // Optional, state is created on first use by this decoder.
+    void        *(*create)(void);
+    void        (*destroy)(void *state);
+
+    // Writes into `*pixels`, reallocating it when `*capacity` is too small.
+    bool        (*decode)(
+        void            *state,
+        const uint8_t   *data,
+        size_t          size,
+        uint8_t         **pixels,
+        size_t          *capacity,
+        uint32_t        *cx,
+        uint32_t        *cy
+    );
+};
+
+extern const struct image_decoder_backend image_decoder_qoi;
+#ifdef HAVE_FFMPEG_DECODER
+extern const struct image_decoder_backend image_decoder_ffmpeg;
+#endif
+extern const struct image_decoder_backend image_decoder_magick;
+
+typedef struct image_decoder image_decoder_t;
+
+image_decoder_t *image_decoder_create(void);
+void image_decoder_destroy(image_decoder_t *decoder);
+
+// Returns `*pixels` on success, NULL if no backend could decode the payload.
+uint8_t *image_decoder_decode(
+    image_decoder_t     *decoder,
+    const uint8_t       *data,
+    size_t              size,
+    uint8_t             **pixels,
+    size_t              *capacity,
+    uint32_t            *cx,
+    uint32_t            *cy
+);
+
+// For backends: makes `*pixels` hold at least `size` bytes, contents are not
+// kept when it grows. Output buffers come from the pixel pool.
+uint8_t *image_decoder_reserve(uint8_t **pixels, size_t *capacity, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
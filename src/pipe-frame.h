@@ -0,0 +1,338 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <util/c99defs.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================================================== //
+// Raw frame layout
+//
+// Alternative to the protobuf `Frame` message for publishers that want to
+// avoid the `bytes` field copy: a fixed little-endian header immediately
+// followed by the pixel rows. `header_size` lets newer publishers append
+// fields without breaking older subscribers.
+//
+// Version 2 adds dirty rectangles: with `rect_count` > 0 the header is
+// followed by `rect_count` rects and then one tightly packed tile per rect,
+// in the same order. `width`/`height` still describe the full frame and
+// `stride` is ignored for tiles.
+//
+// Version 3 adds planar YUV formats and their colour description. Planes
+// follow each other without gaps; `stride` is the luma stride, NV12 chroma
+// rows use the same stride and I420 chroma rows half of it. YUV frames must
+// have even dimensions and cannot carry dirty rects.
+//
+// Version 4 adds the publisher's presentation timestamp in nanoseconds. Only
+// differences between frames matter; zero falls back to the eCAL send time.
+//
+// Version 5 turns the version 2 `reserved` field into `flags` and adds the
+// packed 24-bit RGB24 and BGR24 formats, which are expanded to 32 bits on
+// receive. With OBS_PIPE_FLAG_STRAIGHT_ALPHA set, 32-bit RGB pixels carry
+// straight alpha and are premultiplied on receive.
+//
+// Version 6 adds high bit depth formats: half-float RGBA16F, 10-bit
+// R10G10B10A2 (R in the low bits) and P010 (16-bit little-endian samples
+// with the value in the top 10 bits, laid out like NV12). Straight alpha
+// applies to RGBA16F and R10G10B10A2 as well. `colorspace` then also
+// describes HDR: 2100 PQ and HLG for P010, linear 709 extended or scRGB for
+// RGBA16F and R10G10B10A2. RGBA16F defaults to scRGB, everything else to
+// sRGB.
+//
+// Compressed formats (PNG, QOI, JPEG) carry one encoded image as payload;
+// `width`, `height` and `stride` are ignored, the image defines them.
+//
+// Version 7 adds audio messages on the same topic. They carry PCM samples as
+// payload, described by `sample_rate` and `channels`; the frame count
+// follows from the payload size. Interleaved formats hold one sample per
+// channel per frame, planar formats one plane per channel back to back.
+// `timestamp` shares the clock of the video frames, so both stay in sync.
+// `width`, `height`, `stride`, `rect_count` and the colour fields are
+// ignored.
+//
+// Version 8 adds QOI_STRIPES, lossless BGRA for pipes that leave the host.
+// The payload starts with a stripe count (1 to OBS_PIPE_MAX_STRIPES) and
+// one encoded size per stripe, all uint32, followed by the stripes back to
+// back. With `rows` = ceil(height / count), stripe i holds rows i * rows up
+// to the end of the frame, coded with the QOI operations from a fresh state:
+// no header, no end marker, channels taken in memory order. `width` and
+// `height` describe the frame, `stride` is ignored, straight alpha applies.
+//
+// Version 9 adds delta frames for content that barely changes, such as
+// screens. A frame flagged OBS_PIPE_FLAG_KEYFRAME is kept by the receiver;
+// one flagged OBS_PIPE_FLAG_DELTA carries its pixels XORed with those of the
+// keyframe `base_id`, so unchanged pixels are zero and compress to almost
+// nothing with QOI_STRIPES. A delta has the format and dimensions of its
+// keyframe and is dropped if that keyframe never arrived, so publishers
+// should send keyframes periodically. Both need a 32 or 64-bit RGB format or
+// QOI_STRIPES (XOR applies to the decoded pixels) and cannot carry rects.
+// Straight alpha is premultiplied after the XOR.
+// ========================================================================== //
+
+#define OBS_PIPE_RAW_MAGIC          0x45504950u    // "PIPE"
+#define OBS_PIPE_RAW_VERSION        9
+#define OBS_PIPE_RAW_HEADER_V1_SIZE 32
+#define OBS_PIPE_MAX_PLANES         3
+#define OBS_PIPE_MAX_STRIPES        256
+
+enum obs_pipe_pixel_format {
+    OBS_PIPE_FORMAT_BGRA        = 0,
+    OBS_PIPE_FORMAT_RGBA        = 1,
+    OBS_PIPE_FORMAT_NV12        = 2,
+    OBS_PIPE_FORMAT_I420        = 3,
+    OBS_PIPE_FORMAT_RGB24       = 4,
+    OBS_PIPE_FORMAT_BGR24       = 5,
+    OBS_PIPE_FORMAT_RGBA16F     = 6,
+    OBS_PIPE_FORMAT_R10G10B10A2 = 7,
+    OBS_PIPE_FORMAT_P010        = 8,
+
+    OBS_PIPE_FORMAT_PNG         = 16,
+    OBS_PIPE_FORMAT_QOI         = 17,
+    OBS_PIPE_FORMAT_JPEG        = 18,
+    OBS_PIPE_FORMAT_QOI_STRIPES = 19,
+
+    OBS_PIPE_FORMAT_AUDIO_S16   = 32,
+    OBS_PIPE_FORMAT_AUDIO_S32   = 33,
+    OBS_PIPE_FORMAT_AUDIO_F32   = 34,
+    OBS_PIPE_FORMAT_AUDIO_F32P  = 35,
+};
+
+enum obs_pipe_flags {
+    OBS_PIPE_FLAG_STRAIGHT_ALPHA = 1 << 0,
+    OBS_PIPE_FLAG_KEYFRAME       = 1 << 1,      // Version 9
+    OBS_PIPE_FLAG_DELTA          = 1 << 2,      // Version 9
+};
+
+enum obs_pipe_colorspace {
+    OBS_PIPE_CS_DEFAULT         = 0,
+    OBS_PIPE_CS_601             = 1,
+    OBS_PIPE_CS_709             = 2,
+
+    // Version 6, YUV formats.
+    OBS_PIPE_CS_2100_PQ         = 3,
+    OBS_PIPE_CS_2100_HLG        = 4,
+
+    // Version 6, RGBA16F and R10G10B10A2. Linear BT.709, 1.0 is the SDR
+    // white level or 80 nits (scRGB).
+    OBS_PIPE_CS_709_EXTENDED    = 5,
+    OBS_PIPE_CS_709_SCRGB       = 6,
+};
+
+enum obs_pipe_range {
+    OBS_PIPE_RANGE_PARTIAL      = 0,
+    OBS_PIPE_RANGE_FULL         = 1,
+};
+
+struct obs_pipe_raw_header {
+    uint32_t                    magic;
+    uint16_t                    version;
+    uint16_t                    header_size;
+    int64_t                     id;
+    uint32_t                    width;
+    uint32_t                    height;
+    uint32_t                    format;
+    uint32_t                    stride;
+
+    // Version 2
+    uint32_t                    rect_count;
+    uint32_t                    flags;          // Version 5, enum obs_pipe_flags
+
+    // Version 3
+    uint16_t                    colorspace;
+    uint16_t                    range;
+    uint32_t                    reserved2;
+
+    // Version 4
+    uint64_t                    timestamp;
+
+    // Version 7, audio messages only.
+    uint32_t                    sample_rate;
+    uint32_t                    channels;
+
+    // Version 9, delta frames only.
+    int64_t                     base_id;
+};
+
+struct obs_pipe_raw_rect {
+    uint32_t                    x;
+    uint32_t                    y;
+    uint32_t                    width;
+    uint32_t                    height;
+};
+
+typedef struct obs_pipe_raw_header obs_pipe_raw_header_t;
+typedef struct obs_pipe_raw_rect obs_pipe_raw_rect_t;
+
+struct obs_pipe_plane {
+    uint32_t                    row_size;
+    uint32_t                    rows;
+    uint32_t                    stride;
+};
+
+static inline bool obs_pipe_format_is_yuv(uint32_t format)
+{
+    return format == OBS_PIPE_FORMAT_NV12
+        || format == OBS_PIPE_FORMAT_I420
+        || format == OBS_PIPE_FORMAT_P010
+        ;
+}
+
+// Bytes per pixel of packed RGB formats, 0 for anything else.
+static inline uint32_t obs_pipe_format_bpp(uint32_t format)
+{
+    switch (format) {
+    case OBS_PIPE_FORMAT_BGRA:
+    case OBS_PIPE_FORMAT_RGBA:
+    case OBS_PIPE_FORMAT_R10G10B10A2:
+        return 4;
+    case OBS_PIPE_FORMAT_RGB24:
+    case OBS_PIPE_FORMAT_BGR24:
+        return 3;
+    case OBS_PIPE_FORMAT_RGBA16F:
+        return 8;
+    }
+    return 0;
+}
+
+static inline bool obs_pipe_format_is_packed24(uint32_t format)
+{
+    return format == OBS_PIPE_FORMAT_RGB24 || format == OBS_PIPE_FORMAT_BGR24;
+}
+
+static inline bool obs_pipe_format_is_compressed(uint32_t format)
+{
+    return format == OBS_PIPE_FORMAT_PNG
+        || format == OBS_PIPE_FORMAT_QOI
+        || format == OBS_PIPE_FORMAT_JPEG
+        ;
+}
+
+// Bytes per sample of audio formats, 0 for anything else.
+static inline uint32_t obs_pipe_audio_sample_size(uint32_t format)
+{
+    switch (format) {
+    case OBS_PIPE_FORMAT_AUDIO_S16:
+        return 2;
+    case OBS_PIPE_FORMAT_AUDIO_S32:
+    case OBS_PIPE_FORMAT_AUDIO_F32:
+    case OBS_PIPE_FORMAT_AUDIO_F32P:
+        return 4;
+    }
+    return 0;
+}
+
+static inline bool obs_pipe_format_is_audio(uint32_t format)
+{
+    return obs_pipe_audio_sample_size(format) != 0;
+}
+
+// Plane layout of a full frame, a zero `stride` means tightly packed rows.
+// Returns the number of planes, 0 for unknown formats or odd YUV sizes.
+static inline size_t obs_pipe_get_planes(
+    uint32_t                    format,
+    uint32_t                    width,
+    uint32_t                    height,
+    uint32_t                    stride,
+    struct obs_pipe_plane       planes[OBS_PIPE_MAX_PLANES]
+) {
+    switch (format) {
+    case OBS_PIPE_FORMAT_BGRA:
+    case OBS_PIPE_FORMAT_RGBA:
+    case OBS_PIPE_FORMAT_RGB24:
+    case OBS_PIPE_FORMAT_BGR24:
+    case OBS_PIPE_FORMAT_RGBA16F:
+    case OBS_PIPE_FORMAT_R10G10B10A2:
+        planes[0].row_size = width * obs_pipe_format_bpp(format);
+        planes[0].rows     = height;
+        planes[0].stride   = stride ? stride : planes[0].row_size;
+        return 1;
+
+    case OBS_PIPE_FORMAT_NV12:
+        if ((width | height) & 1) {
+            return 0;
+        }
+        planes[0].row_size = width;
+        planes[0].rows     = height;
+        planes[0].stride   = stride ? stride : width;
+        planes[1].row_size = width;
+        planes[1].rows     = height / 2;
+        planes[1].stride   = planes[0].stride;
+        return 2;
+
+    case OBS_PIPE_FORMAT_P010:
+        if ((width | height) & 1) {
+            return 0;
+        }
+        planes[0].row_size = width * 2;
+        planes[0].rows     = height;
+        planes[0].stride   = stride ? stride : width * 2;
+        planes[1].row_size = width * 2;
+        planes[1].rows     = height / 2;
+        planes[1].stride   = planes[0].stride;
+        return 2;
+
+    case OBS_PIPE_FORMAT_I420:
+        if ((width | height) & 1) {
+            return 0;
+        }
+        planes[0].row_size = width;
+        planes[0].rows     = height;
+        planes[0].stride   = stride ? stride : width;
+        planes[1].row_size = width / 2;
+        planes[1].rows     = height / 2;
+        planes[1].stride   = planes[0].stride / 2;
+        planes[2]          = planes[1];
+        return 3;
+    }
+
+    return 0;
+}
+
+// Rows per stripe of a QOI_STRIPES frame, the last ones may hold fewer.
+static inline uint32_t obs_pipe_stripe_rows(uint32_t height, uint32_t stripe_count)
+{
+    return (height + stripe_count - 1) / stripe_count;
+}
+
+static inline bool obs_pipe_is_raw_frame(const void *data, size_t size)
+{
+    const obs_pipe_raw_header_t *header = (const obs_pipe_raw_header_t *)data;
+    return size >= OBS_PIPE_RAW_HEADER_V1_SIZE
+        && header->magic == OBS_PIPE_RAW_MAGIC
+        && header->header_size >= OBS_PIPE_RAW_HEADER_V1_SIZE
+        && header->header_size <= size
+        ;
+}
+
+// Copies the header, fields newer than the publisher's version read as zero.
+static inline void obs_pipe_read_raw_header(const void *data, obs_pipe_raw_header_t *header)
+{
+    const uint16_t header_size = ((const obs_pipe_raw_header_t *)data)->header_size;
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header, data, header_size < sizeof(*header) ? header_size : sizeof(*header));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,646 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "pipe-output.h"
+#include "frame-manager.h"
+#include "pipe-frame.h"
+#include "pixel-convert.h"
+#include "pixel-pool.h"
+#include "plugin-support.h"
+#include "stripe-codec.h"
+
+#include <obs-module.h>
+#include <graphics/vec4.h>
+#include <util/threading.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <ecal/ecal.h>
+#include <ecal/msg/protobuf/publisher.h>
+
+// ========================================================================== //
+// Structures
+// ========================================================================== //
+
+typedef eCAL::protobuf::CPublisher<ObsPipe::Proto::Frame> obs_pipe_publisher_t;
+typedef eCAL::CPublisher obs_pipe_raw_publisher_t;
+
+// One message worth of pixels. Raw frames hold the header and the rows,
+// protobuf frames only the tightly packed rows. `transport` is the one it was
+// filled for, settings may change before it is sent.
+struct pipe_output_buffer_t {
+    uint8_t                 *data;
+    size_t                  capacity;
+    size_t                  size;
+    uint32_t                width;
+    uint32_t                height;
+    int64_t                 id;
+    enum frame_transport    transport;
+};
+
+struct pipe_output_t {
+    obs_source_t            *source;
+    std::string             pipe_name;
+    // Written under `mutex` while the publish thread is stopped.
+    enum frame_transport    transport;
+    bool                    compress;           // Raw only, QOI_STRIPES frames.
+    uint32_t                keyframe_interval;  // Raw only, 0 disables deltas.
+
+    // Graphics thread. A zero `stage_time` marks a surface with nothing
+    // staged yet. `render_time` is the video frame `render` holds, other
+    // views drawing the filter in the same frame reuse it.
+    gs_texrender_t          *render;
+    uint64_t                render_time;
+    gs_stagesurf_t          *stage[PIPE_OUTPUT_RING];
+    uint64_t                stage_time[PIPE_OUTPUT_RING];
+    uint32_t                stage_width;
+    uint32_t                stage_height;
+    size_t                  stage_index;
+    int64_t                 next_id;
+    pipe_output_buffer_t    fill;
+
+    // Publish thread. `pending` is the newest frame it has not picked up
+    // yet, an older one still waiting is dropped. `active` lets the
+    // graphics thread skip the readback while nothing publishes.
+    std::thread             thread;
+    std::mutex              mutex;
+    std::condition_variable wake;
+    bool                    running;
+    volatile bool           active;
+    bool                    has_pending;
+    pipe_output_buffer_t    pending;
+    pipe_output_buffer_t    sending;
+    pipe_output_buffer_t    encoded;
+    pipe_output_buffer_t    key;
+    uint32_t                key_age;
+    long                    dropped;
+
+    obs_pipe_publisher_t    publisher;
+    obs_pipe_raw_publisher_t raw_publisher;
+    obs_pipe_frame_t        frame;
+};
+
+// ========================================================================== //
+// Publish thread
+// ========================================================================== //
+// Turns a raw frame into a delta against the last keyframe, in place. Every
+// `keyframe_interval` frames, and whenever the size changes, it becomes the
+// next keyframe instead.
+static void pipe_output_delta(pipe_output_t *output, pipe_output_buffer_t *buffer)
+{
+    pipe_output_buffer_t    *key = &output->key;
+    obs_pipe_raw_header_t   header;
+
+    memcpy(&header, buffer->data, sizeof(header));
+
+    const bool keyframe = output->key_age >= output->keyframe_interval
+        || key->size   != buffer->size
+        || key->width  != buffer->width
+        || key->height != buffer->height
+        ;
+
+    if (keyframe) {
+        header.flags |= OBS_PIPE_FLAG_KEYFRAME;
+        memcpy(buffer->data, &header, sizeof(header));
+
+        pixel_pool_grow(&key->data, &key->capacity, 0, buffer->size);
+        memcpy(key->data, buffer->data, buffer->size);
+        key->size   = buffer->size;
+        key->width  = buffer->width;
+        key->height = buffer->height;
+        key->id     = buffer->id;
+
+        output->key_age = 1;
+        return;
+    }
+
+    header.flags  |= OBS_PIPE_FLAG_DELTA;
+    header.base_id = key->id;
+    memcpy(buffer->data, &header, sizeof(header));
+
+    pixel_convert_xor(
+        buffer->data + sizeof(header),
+        buffer->data + sizeof(header),
+        key->data + sizeof(header),
+        buffer->size - sizeof(header)
+    );
+    output->key_age++;
+}
+
+// Re-encodes a raw frame as QOI_STRIPES, the stripes are spread over the
+// decode pool.
+static pipe_output_buffer_t *pipe_output_encode(pipe_output_t *output, const pipe_output_buffer_t *buffer)
+{
+    pipe_output_buffer_t    *encoded = &output->encoded;
+    obs_pipe_raw_header_t   header;
+
+    memcpy(&header, buffer->data, sizeof(header));
+
+    pixel_pool_grow(
+        &encoded->data,
+        &encoded->capacity,
+        0,
+        sizeof(header) + stripe_codec_bound(header.width, header.height, STRIPE_CODEC_STRIPES)
+    );
+
+    const size_t payload = stripe_codec_encode(
+        encoded->data + sizeof(header),
+        buffer->data + sizeof(header),
+        header.width,
+        header.height,
+        header.stride,
+        STRIPE_CODEC_STRIPES
+    );
+
+    header.format = OBS_PIPE_FORMAT_QOI_STRIPES;
+    header.stride = 0;
+    memcpy(encoded->data, &header, sizeof(header));
+
+    encoded->size   = sizeof(header) + payload;
+    encoded->width  = buffer->width;
+    encoded->height = buffer->height;
+    encoded->id     = buffer->id;
+    return encoded;
+}
+
+static void pipe_output_send(pipe_output_t *output, pipe_output_buffer_t *buffer)
+{
+    // Filled before the transport changed, the publisher cannot send it.
+    if (buffer->transport != output->transport) {
+        return;
+    }
+
+    if (output->keyframe_interval > 0 && output->transport == FRAME_TRANSPORT_RAW) {
+        pipe_output_delta(output, buffer);
+    }
+    if (output->compress && output->transport == FRAME_TRANSPORT_RAW) {
+        buffer = pipe_output_encode(output, buffer);
+    }
+
+    if (output->transport == FRAME_TRANSPORT_PROTOBUF) {
+        output->frame.set_id(buffer->id);
+        output->frame.set_width(buffer->width);
+        output->frame.set_height(buffer->height);
+        output->frame.set_buffer(buffer->data, buffer->size);
+        output->publisher.Send(output->frame);
+    } else {
+        output->raw_publisher.Send(buffer->data, buffer->size);
+    }
+}
+
+static void pipe_output_thread(pipe_output_t *output)
+{
+    os_set_thread_name("pipe-output");
+
+    std::unique_lock<std::mutex> lock(output->mutex);
+
+    for (;;) {
+        output->wake.wait(lock, [output] {
+            return output->has_pending || !output->running;
+        });
+        if (!output->running) {
+            break;
+        }
+
+        std::swap(output->pending, output->sending);
+        output->has_pending = false;
+
+        // Sending may take a while on network layers, the graphics thread
+        // keeps filling in the meantime.
+        lock.unlock();
+        pipe_output_send(output, &output->sending);
+        lock.lock();
+    }
+}
+
+static void pipe_output_start(pipe_output_t *output)
+{
+    if (output->pipe_name.empty()) {
+        return;
+    }
+
+    obs_log(LOG_INFO, "creating publisher for '%s'", output->pipe_name.c_str());
+
+    if (output->transport == FRAME_TRANSPORT_PROTOBUF) {
+        output->publisher.Create(output->pipe_name);
+    } else {
+        output->raw_publisher.Create(output->pipe_name);
+    }
+
+    output->running  = true;
+    output->dropped  = 0;
+    output->key.size = 0;
+    output->thread  = std::thread(pipe_output_thread, output);
+    os_atomic_set_bool(&output->active, true);
+}
+
+static void pipe_output_stop(pipe_output_t *output)
+{
+    os_atomic_set_bool(&output->active, false);
+
+    {
+        std::lock_guard<std::mutex> lock(output->mutex);
+        output->running     = false;
+        output->has_pending = false;
+    }
+    output->wake.notify_one();
+
+    if (output->thread.joinable()) {
+        output->thread.join();
+    }
+
+    if (output->publisher.IsCreated()) {
+        output->publisher.Destroy();
+    }
+    if (output->raw_publisher.IsCreated()) {
+        output->raw_publisher.Destroy();
+    }
+
+    if (output->dropped > 0) {
+        obs_log(LOG_DEBUG, "pipe output: %ld frames dropped while sending", output->dropped);
+    }
+}
+
+// ========================================================================== //
+// Readback
+// ========================================================================== //
+
+// Hands the filled buffer to the publish thread, swapping in the one it
+// replaces.
+static void pipe_output_queue(pipe_output_t *output)
+{
+    std::lock_guard<std::mutex> lock(output->mutex);
+
+    if (!output->running) {
+        return;
+    }
+
+    if (output->has_pending) {
+        output->dropped++;
+    }
+
+    std::swap(output->fill, output->pending);
+    output->has_pending = true;
+    output->wake.notify_one();
+}
+
+// Copies a staged frame out of driver memory. Raw frames keep the surface's
+// row pitch, so this is a single copy.
+static void pipe_output_copy_surface(pipe_output_t *output, gs_stagesurf_t *surface, uint64_t timestamp)
+{
+    const uint32_t          cx       = output->stage_width;
+    const uint32_t          cy       = output->stage_height;
+    const uint32_t          row_size = cx * 4;
+    pipe_output_buffer_t    *buffer  = &output->fill;
+
+    uint8_t     *data;
+    uint32_t    linesize;
+
+    if (!gs_stagesurface_map(surface, &data, &linesize)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(output->mutex);
+        buffer->transport = output->transport;
+    }
+
+    if (buffer->transport == FRAME_TRANSPORT_PROTOBUF) {
+        buffer->size = (size_t)row_size * cy;
+        pixel_pool_grow(&buffer->data, &buffer->capacity, 0, buffer->size);
+
+        if (linesize == row_size) {
+            memcpy(buffer->data, data, buffer->size);
+        } else {
+            for (uint32_t y = 0; y < cy; y++) {
+                memcpy(buffer->data + (size_t)y * row_size, data + (size_t)y * linesize, row_size);
+            }
+        }
+    } else {
+        obs_pipe_raw_header_t header = {};
+        header.magic       = OBS_PIPE_RAW_MAGIC;
+        header.version     = OBS_PIPE_RAW_VERSION;
+        header.header_size = sizeof(header);
+        header.id          = output->next_id;
+        header.width       = cx;
+        header.height      = cy;
+        header.format      = OBS_PIPE_FORMAT_BGRA;
+        header.stride      = linesize;
+        header.colorspace  = OBS_PIPE_CS_DEFAULT;
+        header.range       = OBS_PIPE_RANGE_FULL;
+        header.timestamp   = timestamp;
+
+        const size_t pixels = (size_t)linesize * (cy - 1) + row_size;
+
+        buffer->size = sizeof(header) + pixels;
+        pixel_pool_grow(&buffer->data, &buffer->capacity, 0, buffer->size);
+
+        memcpy(buffer->data, &header, sizeof(header));
+        memcpy(buffer->data + sizeof(header), data, pixels);
+    }
+
+    gs_stagesurface_unmap(surface);
+
+    buffer->width  = cx;
+    buffer->height = cy;
+    buffer->id     = output->next_id++;
+
+    pipe_output_queue(output);
+}
+
+static void pipe_output_destroy_surfaces(pipe_output_t *output)
+{
+    for (size_t i = 0; i < PIPE_OUTPUT_RING; i++) {
+        if (output->stage[i]) {
+            gs_stagesurface_destroy(output->stage[i]);
+            output->stage[i] = NULL;
+        }
+        output->stage_time[i] = 0;
+    }
+
+    output->stage_width  = 0;
+    output->stage_height = 0;
+    output->stage_index  = 0;
+}
+
+// Maps the surface staged PIPE_OUTPUT_RING frames ago, its copy finished
+// long since, then stages this frame into it.
+static void pipe_output_readback(pipe_output_t *output, gs_texture_t *texture, uint32_t cx, uint32_t cy)
+{
+    if (cx != output->stage_width || cy != output->stage_height) {
+        pipe_output_destroy_surfaces(output);
+
+        for (size_t i = 0; i < PIPE_OUTPUT_RING; i++) {
+            output->stage[i] = gs_stagesurface_create(cx, cy, GS_BGRA);
+            if (!output->stage[i]) {
+                obs_log(LOG_ERROR, "failed to create staging surface");
+                pipe_output_destroy_surfaces(output);
+                return;
+            }
+        }
+
+        output->stage_width  = cx;
+        output->stage_height = cy;
+    }
+
+    const size_t    index    = output->stage_index;
+    gs_stagesurf_t  *surface = output->stage[index];
+
+    if (output->stage_time[index] != 0) {
+        pipe_output_copy_surface(output, surface, output->stage_time[index]);
+    }
+
+    gs_stage_texture(surface, texture);
+    output->stage_time[index] = obs_get_video_frame_time();
+    output->stage_index       = (index + 1) % PIPE_OUTPUT_RING;
+}
+
+// ========================================================================== //
+// Pipe Output Filter
+// ========================================================================== //
+static const char *pipe_output_get_name(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+    return obs_module_text("Pipe Output");
+}
+
+static void pipe_output_get_defaults(obs_data_t *settings)
+{
+    obs_data_set_default_string(settings, "pipe_name", "");
+    obs_data_set_default_int(settings, "transport", FRAME_TRANSPORT_RAW);
+    obs_data_set_default_bool(settings, "compress", false);
+    obs_data_set_default_int(settings, "keyframe_interval", 0);
+}
+
+// Compression and delta frames only exist in the raw layout.
+static bool pipe_output_transport_modified(obs_properties_t *props, obs_property_t *property, obs_data_t *settings)
+{
+    UNUSED_PARAMETER(property);
+
+    const bool raw = obs_data_get_int(settings, "transport") != FRAME_TRANSPORT_PROTOBUF;
+    obs_property_set_enabled(obs_properties_get(props, "compress"),          raw);
+    obs_property_set_enabled(obs_properties_get(props, "keyframe_interval"), raw);
+    return true;
+}
+
+static obs_properties_t *pipe_output_get_properties(void *data)
+{
+    obs_properties_t *props = obs_properties_create();
+
+    UNUSED_PARAMETER(data);
+
+    obs_properties_add_text(props, "pipe_name", obs_module_text("PipeName"), OBS_TEXT_DEFAULT);
+
+    obs_property_t *transport = obs_properties_add_list(
+        props,
+        "transport",
+        obs_module_text("Transport"),
+        OBS_COMBO_TYPE_LIST,
+        OBS_COMBO_FORMAT_INT
+    );
+    obs_property_list_add_int(transport, obs_module_text("Transport.Raw"),      FRAME_TRANSPORT_RAW);
+    obs_property_list_add_int(transport, obs_module_text("Transport.Protobuf"), FRAME_TRANSPORT_PROTOBUF);
+    obs_property_set_modified_callback(transport, pipe_output_transport_modified);
+
+    obs_property_t *compress = obs_properties_add_bool(props, "compress", obs_module_text("Compress"));
+    obs_property_set_long_description(compress, obs_module_text("Compress.Description"));
+
+    obs_property_t *keyframes = obs_properties_add_int(
+        props,
+        "keyframe_interval",
+        obs_module_text("KeyframeInterval"),
+        0,
+        600,
+        1
+    );
+    obs_property_set_long_description(keyframes, obs_module_text("KeyframeInterval.Description"));
+
+    return props;
+}
+
+static void pipe_output_update(void *data, obs_data_t *settings)
+{
+    pipe_output_t *output = (pipe_output_t *)data;
+
+    const char  *pipe_name = obs_data_get_string(settings, "pipe_name");
+    const bool  protobuf   = obs_data_get_int(settings, "transport") == FRAME_TRANSPORT_PROTOBUF;
+    const auto  transport  = protobuf ? FRAME_TRANSPORT_PROTOBUF : FRAME_TRANSPORT_RAW;
+    const bool  compress   = obs_data_get_bool(settings, "compress");
+    const auto  keyframes  = (uint32_t)obs_data_get_int(settings, "keyframe_interval");
+
+    if (output->running && output->pipe_name == pipe_name && output->transport == transport
+        && output->compress == compress && output->keyframe_interval == keyframes) {
+        return;
+    }
+
+    pipe_output_stop(output);
+    {
+        std::lock_guard<std::mutex> lock(output->mutex);
+        output->pipe_name         = pipe_name;
+        output->transport         = transport;
+        output->compress          = compress;
+        output->keyframe_interval = keyframes;
+    }
+    pipe_output_start(output);
+}
+
+static void *pipe_output_create(obs_data_t *settings, obs_source_t *source)
+{
+    pipe_output_t *output = new pipe_output_t();
+
+    output->source = source;
+    pipe_output_update(output, settings);
+
+    return output;
+}
+
+static void pipe_output_destroy(void *data)
+{
+    pipe_output_t *output = (pipe_output_t *)data;
+
+    pipe_output_stop(output);
+
+    obs_enter_graphics();
+    pipe_output_destroy_surfaces(output);
+    gs_texrender_destroy(output->render);
+    obs_leave_graphics();
+
+    pixel_pool_free(output->fill.data,    output->fill.capacity);
+    pixel_pool_free(output->pending.data, output->pending.capacity);
+    pixel_pool_free(output->sending.data, output->sending.capacity);
+    pixel_pool_free(output->encoded.data, output->encoded.capacity);
+    pixel_pool_free(output->key.data,     output->key.capacity);
+
+    delete output;
+}
+
+// Renders the target into `render`, replacing what was there.
+static bool pipe_output_render_target(
+    pipe_output_t               *output,
+    obs_source_t                *target,
+    obs_source_t                *parent,
+    uint32_t                    cx,
+    uint32_t                    cy
+) {
+    gs_texrender_reset(output->render);
+    if (!gs_texrender_begin(output->render, cx, cy)) {
+        return false;
+    }
+
+    struct vec4 clear_color;
+    vec4_zero(&clear_color);
+    gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+    gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+    gs_blend_state_push();
+    gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+    // Rendering the parent itself would run the filter chain again.
+    const uint32_t flags = obs_source_get_output_flags(target);
+    if (target == parent && !(flags & OBS_SOURCE_CUSTOM_DRAW) && !(flags & OBS_SOURCE_ASYNC)) {
+        obs_source_default_render(target);
+    } else {
+        obs_source_video_render(target);
+    }
+
+    gs_blend_state_pop();
+    gs_texrender_end(output->render);
+    return true;
+}
+
+// Draws the target into a texture, stages it for readback and passes the
+// texture on, so the source is only rendered once. Studio mode, multiview and
+// projectors render the filter more than once per video frame, only the first
+// pass renders and stages.
+static void pipe_output_render(void *data, gs_effect_t *effect)
+{
+    pipe_output_t *output = (pipe_output_t *)data;
+
+    UNUSED_PARAMETER(effect);
+
+    obs_source_t    *target = obs_filter_get_target(output->source);
+    obs_source_t    *parent = obs_filter_get_parent(output->source);
+    const uint32_t  cx      = target ? obs_source_get_base_width(target)  : 0;
+    const uint32_t  cy      = target ? obs_source_get_base_height(target) : 0;
+
+    if (!os_atomic_load_bool(&output->active) || !parent || cx == 0 || cy == 0) {
+        obs_source_skip_video_filter(output->source);
+        return;
+    }
+
+    if (!output->render) {
+        output->render = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+    }
+
+    const uint64_t  frame_time = obs_get_video_frame_time();
+    gs_texture_t    *texture   = gs_texrender_get_texture(output->render);
+
+    const bool rendered = texture
+        && output->render_time == frame_time
+        && gs_texture_get_width(texture)  == cx
+        && gs_texture_get_height(texture) == cy
+        ;
+
+    if (!rendered) {
+        if (!pipe_output_render_target(output, target, parent, cx, cy)) {
+            obs_source_skip_video_filter(output->source);
+            return;
+        }
+
+        texture = gs_texrender_get_texture(output->render);
+        pipe_output_readback(output, texture, cx, cy);
+        output->render_time = frame_time;
+    }
+
+    gs_effect_t *const draw = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+
+    const bool previous = gs_framebuffer_srgb_enabled();
+    gs_enable_framebuffer_srgb(true);
+
+    gs_blend_state_push();
+    gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+    gs_effect_set_texture_srgb(gs_effect_get_param_by_name(draw, "image"), texture);
+    while (gs_effect_loop(draw, "Draw")) {
+        gs_draw_sprite(texture, 0, cx, cy);
+    }
+
+    gs_blend_state_pop();
+    gs_enable_framebuffer_srgb(previous);
+}
+
+struct obs_source_info pipe_output_filter_info_init(void)
+{
+    struct obs_source_info info = {};
+
+    info.id             = "pipe_output_filter";
+    info.type           = OBS_SOURCE_TYPE_FILTER;
+    info.output_flags   = OBS_SOURCE_VIDEO | OBS_SOURCE_SRGB;
+    info.get_name       = pipe_output_get_name;
+    info.create         = pipe_output_create;
+    info.destroy        = pipe_output_destroy;
+    info.get_defaults   = pipe_output_get_defaults;
+    info.get_properties = pipe_output_get_properties;
+    info.update         = pipe_output_update;
+    info.video_render   = pipe_output_render;
+
+    return info;
+}
@@ -0,0 +1,40 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <obs.h>
+
+// ========================================================================== //
+// Pipe output
+//
+// Video filter publishing the frames of the source it sits on back onto a
+// pipe, for external processes that consume OBS scenes. The source is drawn
+// into a texture once per frame, read back through a ring of staging
+// surfaces so the map never waits on the GPU, and handed to a publish thread
+// so eCAL never blocks the graphics thread.
+//
+// Frames go out as raw frames keeping the staging surface's row pitch, or as
+// protobuf `Frame` messages with tightly packed rows. Either way they carry
+// premultiplied BGRA, like OBS renders them.
+// ========================================================================== //
+
+// Frames a readback lags behind the render.
+#define PIPE_OUTPUT_RING 3
+
+struct obs_source_info pipe_output_filter_info_init(void);
@@ -0,0 +1,233 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "pipe-registry.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+#include <util/platform.h>
+
+#include <mutex>
+#include <unordered_map>
+
+static std::mutex                                       registry_mutex;
+static std::unordered_map<std::string, pipe_shared_t *> registry;
+
+static std::string pipe_registry_key(const pipe_shared_config_t *config)
+{
+    std::string key = config->pipe_name ? config->pipe_name : "";
+    key += '\n';
+    key += std::to_string((int)config->mode);
+    key += ':';
+    key += std::to_string((int)config->transport);
+    key += ':';
+    key += std::to_string((int)config->pacing);
+    key += ':';
+    key += std::to_string(config->jitter_delay_ms);
+    key += ':';
+    key += config->straight_alpha ? '1' : '0';
+    key += config->linear_alpha ? '1' : '0';
+    key += config->gpu_convert ? '1' : '0';
+    return key;
+}
+
+pipe_shared_t *pipe_registry_acquire(const pipe_shared_config_t *config)
+{
+    const std::string key = pipe_registry_key(config);
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    auto it = registry.find(key);
+    if (it != registry.end()) {
+        it->second->refs++;
+        return it->second;
+    }
+
+    pipe_shared_t *pipe = new pipe_shared_t();
+    pipe->key            = key;
+    pipe->pipe_name      = config->pipe_name ? config->pipe_name : "";
+    pipe->refs           = 1;
+    pipe->users          = 0;
+    pipe->linear_alpha   = config->linear_alpha;
+    pipe->last_load      = 0;
+    pipe->last_frame_id  = -1;
+    pipe->last_frame_pts = 0;
+    pipe_stats_init(&pipe->stats);
+
+    frame_manager_config_t receiver_config = {};
+    receiver_config.pipe_name       = config->pipe_name;
+    receiver_config.mode            = config->mode;
+    receiver_config.transport       = config->transport;
+    receiver_config.pacing          = config->pacing;
+    receiver_config.jitter_delay_ms = config->jitter_delay_ms;
+    receiver_config.straight_alpha  = config->straight_alpha;
+    receiver_config.linear_alpha    = config->linear_alpha;
+    receiver_config.gpu_convert     = config->gpu_convert;
+
+    // Subscribes once the first source uses it.
+    pipe->receiver.paused = true;
+    frame_manager_open(&pipe->receiver, &receiver_config);
+
+    registry.emplace(key, pipe);
+    return pipe;
+}
+
+void pipe_registry_release(pipe_shared_t *pipe)
+{
+    if (!pipe) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (--pipe->refs > 0) {
+            return;
+        }
+        registry.erase(pipe->key);
+    }
+
+    frame_manager_close(&pipe->receiver);
+
+    obs_enter_graphics();
+    gs_image_buffer_free(&pipe->image);
+    obs_leave_graphics();
+
+    pipe_stats_free(&pipe->stats);
+    delete pipe;
+}
+
+void pipe_shared_load(pipe_shared_t *pipe, uint64_t frame_time)
+{
+    // Another source on this pipe already received this video frame.
+    if (pipe->last_load == frame_time) {
+        return;
+    }
+    pipe->last_load = frame_time;
+
+    if (!eCAL::Ok()) {
+        return;
+    }
+
+    const frame_slot_t *frame = frame_manager_receive(&pipe->receiver);
+    if (pipe->receiver.burst) {
+        pipe_stats_record_burst(&pipe->stats);
+    }
+    if (!frame) {
+        return;
+    }
+
+    // Publishers that resend the current frame at a fixed rate, nothing to
+    // upload. Only frames that carry a timestamp are compared, protobuf ids
+    // are often left at 0, and a restarted publisher may repeat an id.
+    const bool resent = frame->pts != 0
+        && frame->pts == pipe->last_frame_pts
+        && frame->id  == pipe->last_frame_id
+        ;
+    if (resent && !frame->partial) {
+        pipe_stats_record_unchanged(&pipe->stats);
+        return;
+    }
+
+    // The slot is owned by the video thread until the next receive, so the
+    // pixels stay put.
+    if (frame->partial) {
+        const bool patched = gs_image_buffer_init_from_rects(
+            &pipe->image,
+            frame->data,
+            frame->size,
+            frame->rects,
+            frame->rect_count,
+            frame->width,
+            frame->height,
+            frame->format
+        );
+        if (!patched) {
+            return;
+        }
+    } else if (frame->video_format != VIDEO_FORMAT_NONE) {
+        gs_image_buffer_init_from_yuv_planes(
+            &pipe->image,
+            frame->data,
+            frame->size,
+            frame->width,
+            frame->height,
+            frame->linesize,
+            frame->video_format,
+            frame->colorspace,
+            frame->range,
+            frame->swap_rb
+        );
+    } else {
+        gs_image_buffer_init_from_raw_pixels(
+            &pipe->image,
+            frame->data,
+            frame->size,
+            frame->width,
+            frame->height,
+            frame->linesize[0],
+            frame->format,
+            !frame->straight_alpha  ? GS_IMAGE_ALPHA_STRAIGHT
+            : pipe->linear_alpha    ? GS_IMAGE_ALPHA_PREMULTIPLY_SRGB
+            : GS_IMAGE_ALPHA_PREMULTIPLY,
+            frame->color_space
+        );
+    }
+    pipe->last_frame_id  = frame->id;
+    pipe->last_frame_pts = frame->pts;
+
+    const uint64_t upload_start = os_gettime_ns();
+    obs_enter_graphics();
+    gs_image_buffer_init_texture(&pipe->image);
+    obs_leave_graphics();
+
+    // The slot goes back to the publisher on the next receive.
+    gs_image_buffer_release_data(&pipe->image);
+    const uint64_t upload_end = os_gettime_ns();
+
+    pipe_stats_record_upload(&pipe->stats, upload_end - upload_start);
+    pipe_stats_record_frame(
+        &pipe->stats,
+        frame->id,
+        frame->size,
+        upload_end > frame->timestamp ? upload_end - frame->timestamp : 0
+    );
+
+    if (!pipe->image.texture) {
+        obs_log(LOG_WARNING, "failed to load texture");
+    }
+}
+
+void pipe_shared_use(pipe_shared_t *pipe)
+{
+    // Sources unload from destroy too, which is not on the video thread.
+    std::lock_guard<std::mutex> lock(pipe->users_mutex);
+    if (pipe->users++ == 0) {
+        frame_manager_resume(&pipe->receiver);
+    }
+}
+
+void pipe_shared_unuse(pipe_shared_t *pipe)
+{
+    std::lock_guard<std::mutex> lock(pipe->users_mutex);
+    if (--pipe->users > 0) {
+        return;
+    }
+
+    // The texture stays, it is what gets drawn when shown again.
+    frame_manager_pause(&pipe->receiver);
+}
@@ -0,0 +1,81 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <mutex>
+#include <string>
+
+#include "frame-manager.h"
+#include "image-buffer.h"
+#include "pipe-stats.h"
+
+// ========================================================================== //
+// Pipe registry
+//
+// Sync sources watching the same pipe with the same receive options share a
+// single subscriber, texture and set of stats. The first source to tick in a
+// video frame receives and uploads, the others draw what it uploaded.
+//
+// The subscriber only runs while some source uses the pipe. The texture of
+// the last frame is kept until the pipe is released, so a source that is
+// shown again draws immediately.
+//
+// Acquire and release happen from source update/destroy, use and unuse
+// from the video tick. Load happens from the tick, or from video_render for
+// sources that upload lazily; both run on the video thread.
+// ========================================================================== //
+
+struct pipe_shared_config_t {
+    const char                  *pipe_name;
+    enum frame_receive_mode     mode;
+    enum frame_transport        transport;
+    enum frame_pacing           pacing;
+    uint32_t                    jitter_delay_ms;
+    bool                        straight_alpha;
+    bool                        linear_alpha;
+    bool                        gpu_convert;
+};
+
+struct pipe_shared_t {
+    std::string             key;
+    std::string             pipe_name;
+    long                    refs;           // Guarded by the registry.
+    std::mutex              users_mutex;
+    long                    users;          // Sources showing the pipe.
+    bool                    linear_alpha;
+
+    uint64_t                last_load;      // Video frame time.
+    int64_t                 last_frame_id;
+    uint64_t                last_frame_pts;
+
+    frame_manager_t         receiver;
+    gs_image_buffer_t       image;
+    pipe_stats_t            stats;
+};
+
+pipe_shared_t *pipe_registry_acquire(const pipe_shared_config_t *config);
+void pipe_registry_release(pipe_shared_t *pipe);
+
+// Receives and uploads at most once per `frame_time`.
+void pipe_shared_load(pipe_shared_t *pipe, uint64_t frame_time);
+
+// Sources count themselves in and out of `users`, the subscriber is paused
+// while nobody uses the pipe.
+void pipe_shared_use(pipe_shared_t *pipe);
+void pipe_shared_unuse(pipe_shared_t *pipe);
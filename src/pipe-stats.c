@@ -0,0 +1,243 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "pipe-stats.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+#include <util/base.h>
+
+#include <string.h>
+
+// ========================================================================== //
+// Histogram
+// ========================================================================== //
+static void pipe_histogram_add(struct pipe_histogram *histogram, uint64_t ns)
+{
+    uint64_t    us     = ns / 1000;
+    size_t      bucket = 0;
+
+    while (us > 1 && bucket < PIPE_STATS_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum_ns += ns;
+    if (ns > histogram->max_ns) {
+        histogram->max_ns = ns;
+    }
+}
+
+// Upper bound of the bucket holding the given percentile, in milliseconds.
+static double pipe_histogram_percentile(const struct pipe_histogram *histogram, double percentile)
+{
+    if (histogram->count == 0) {
+        return 0.0;
+    }
+
+    const uint64_t  target = (uint64_t)(histogram->count * percentile / 100.0);
+    uint64_t        seen   = 0;
+
+    for (size_t i = 0; i < PIPE_STATS_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen > target) {
+            return i == PIPE_STATS_BUCKETS - 1
+                ? histogram->max_ns / 1000000.0
+                : (double)(2ULL << i) / 1000.0;
+        }
+    }
+
+    return histogram->max_ns / 1000000.0;
+}
+
+static double pipe_histogram_mean(const struct pipe_histogram *histogram)
+{
+    return histogram->count > 0
+        ? histogram->sum_ns / (double)histogram->count / 1000000.0
+        : 0.0;
+}
+
+// ========================================================================== //
+// Pipe stats
+// ========================================================================== //
+void pipe_stats_init(pipe_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_init(&stats->mutex, NULL);
+    stats->last_id = -1;
+}
+
+void pipe_stats_free(pipe_stats_t *stats)
+{
+    pthread_mutex_destroy(&stats->mutex);
+}
+
+void pipe_stats_reset(pipe_stats_t *stats)
+{
+    pthread_mutex_lock(&stats->mutex);
+    stats->frames          = 0;
+    stats->skipped         = 0;
+    stats->bytes           = 0;
+    stats->unchanged       = 0;
+    stats->bursts          = 0;
+    stats->last_id         = -1;
+    stats->has_last_window = false;
+    memset(&stats->window, 0, sizeof(stats->window));
+    pthread_mutex_unlock(&stats->mutex);
+}
+
+void pipe_stats_record_frame(pipe_stats_t *stats, int64_t id, size_t bytes, uint64_t latency_ns)
+{
+    pthread_mutex_lock(&stats->mutex);
+
+    // Gaps in the publisher's ids are frames that never made it to a texture,
+    // whether eCAL or the mailbox dropped them.
+    uint64_t skipped = 0;
+    if (stats->last_id >= 0 && id > stats->last_id + 1) {
+        skipped = (uint64_t)(id - stats->last_id - 1);
+    }
+    stats->last_id = id;
+
+    stats->frames++;
+    stats->skipped        += skipped;
+    stats->bytes          += bytes;
+    stats->window.frames++;
+    stats->window.skipped += skipped;
+    stats->window.bytes   += bytes;
+
+    if (latency_ns > 0) {
+        pipe_histogram_add(&stats->window.latency, latency_ns);
+    }
+
+    pthread_mutex_unlock(&stats->mutex);
+}
+
+void pipe_stats_record_upload(pipe_stats_t *stats, uint64_t upload_ns)
+{
+    pthread_mutex_lock(&stats->mutex);
+    pipe_histogram_add(&stats->window.upload, upload_ns);
+    pthread_mutex_unlock(&stats->mutex);
+}
+
+void pipe_stats_record_unchanged(pipe_stats_t *stats)
+{
+    pthread_mutex_lock(&stats->mutex);
+    stats->unchanged++;
+    pthread_mutex_unlock(&stats->mutex);
+}
+
+void pipe_stats_record_burst(pipe_stats_t *stats)
+{
+    pthread_mutex_lock(&stats->mutex);
+    stats->bursts++;
+    pthread_mutex_unlock(&stats->mutex);
+}
+
+void pipe_stats_tick(pipe_stats_t *stats, const char *name, uint64_t now)
+{
+    pthread_mutex_lock(&stats->mutex);
+
+    if (stats->window.start == 0) {
+        stats->window.start = now;
+    }
+
+    const uint64_t elapsed = now - stats->window.start;
+    if (elapsed < PIPE_STATS_LOG_INTERVAL_NS) {
+        pthread_mutex_unlock(&stats->mutex);
+        return;
+    }
+
+    struct pipe_stats_window window = stats->window;
+    window.elapsed = elapsed;
+
+    stats->last_window     = window;
+    stats->has_last_window = true;
+    memset(&stats->window, 0, sizeof(stats->window));
+    stats->window.start    = now;
+
+    pthread_mutex_unlock(&stats->mutex);
+
+    if (window.frames == 0) {
+        return;
+    }
+
+    const double seconds = elapsed / 1000000000.0;
+
+    obs_log(
+        LOG_INFO,
+        "[%s] %.1f fps, %.2f MB/s, %llu skipped, latency p50 %.2f ms p95 %.2f ms max %.2f ms, "
+        "upload p50 %.2f ms p95 %.2f ms max %.2f ms",
+        name ? name : "",
+        window.frames / seconds,
+        window.bytes / seconds / 1000000.0,
+        (unsigned long long)window.skipped,
+        pipe_histogram_percentile(&window.latency, 50.0),
+        pipe_histogram_percentile(&window.latency, 95.0),
+        window.latency.max_ns / 1000000.0,
+        pipe_histogram_percentile(&window.upload, 50.0),
+        pipe_histogram_percentile(&window.upload, 95.0),
+        window.upload.max_ns / 1000000.0
+    );
+}
+
+void pipe_stats_describe(pipe_stats_t *stats, struct dstr *out)
+{
+    pthread_mutex_lock(&stats->mutex);
+
+    dstr_catf(out, "%s: %llu\n",    obs_module_text("Stats.FramesReceived"),  (unsigned long long)stats->frames);
+    dstr_catf(out, "%s: %llu\n",    obs_module_text("Stats.FramesSkipped"),   (unsigned long long)stats->skipped);
+    dstr_catf(out, "%s: %llu\n",    obs_module_text("Stats.FramesUnchanged"), (unsigned long long)stats->unchanged);
+    dstr_catf(out, "%s: %llu\n",    obs_module_text("Stats.Bursts"),          (unsigned long long)stats->bursts);
+    dstr_catf(out, "%s: %.1f MB\n", obs_module_text("Stats.BytesReceived"),   stats->bytes / 1000000.0);
+
+    // Ticks stop while the source is hidden, so a window can be far longer
+    // than PIPE_STATS_LOG_INTERVAL_NS.
+    if (stats->has_last_window && stats->last_window.elapsed > 0) {
+        const struct pipe_stats_window  *window  = &stats->last_window;
+        const double                    seconds  = window->elapsed / 1000000000.0;
+
+        dstr_catf(out, "%s: %.1f fps\n",  obs_module_text("Stats.FrameRate"), window->frames / seconds);
+        dstr_catf(out, "%s: %.2f MB/s\n", obs_module_text("Stats.Bandwidth"), window->bytes / seconds / 1000000.0);
+        dstr_catf(
+            out,
+            "%s: %s %.2f ms, p95 %.2f ms, %s %.2f ms\n",
+            obs_module_text("Stats.ReceiveToUpload"),
+            obs_module_text("Stats.Mean"),
+            pipe_histogram_mean(&window->latency),
+            pipe_histogram_percentile(&window->latency, 95.0),
+            obs_module_text("Stats.Max"),
+            window->latency.max_ns / 1000000.0
+        );
+        dstr_catf(
+            out,
+            "%s: %s %.2f ms, p95 %.2f ms, %s %.2f ms",
+            obs_module_text("Stats.Upload"),
+            obs_module_text("Stats.Mean"),
+            pipe_histogram_mean(&window->upload),
+            pipe_histogram_percentile(&window->upload, 95.0),
+            obs_module_text("Stats.Max"),
+            window->upload.max_ns / 1000000.0
+        );
+    } else {
+        dstr_cat(out, obs_module_text("Stats.Pending"));
+    }
+
+    pthread_mutex_unlock(&stats->mutex);
+}
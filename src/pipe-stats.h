@@ -0,0 +1,96 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <util/c99defs.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================================================== //
+// Pipe stats
+//
+// Per-source counters and latency histograms, recorded on the video thread
+// and read from the UI thread for the properties panel. Histograms use
+// power-of-two microsecond buckets, so percentiles are upper bounds.
+// ========================================================================== //
+
+#define PIPE_STATS_BUCKETS          21
+#define PIPE_STATS_LOG_INTERVAL_NS  30000000000ULL
+
+struct pipe_histogram {
+    uint64_t                    buckets[PIPE_STATS_BUCKETS];
+    uint64_t                    count;
+    uint64_t                    sum_ns;
+    uint64_t                    max_ns;
+};
+
+struct pipe_stats_window {
+    uint64_t                    start;
+    uint64_t                    elapsed;        // ns, once completed.
+    uint64_t                    frames;
+    uint64_t                    skipped;
+    uint64_t                    bytes;
+    struct pipe_histogram       latency;
+    struct pipe_histogram       upload;
+};
+
+struct pipe_stats {
+    pthread_mutex_t             mutex;
+
+    // Since the settings of a source on the pipe were last updated.
+    uint64_t                    frames;
+    uint64_t                    skipped;
+    uint64_t                    bytes;
+    uint64_t                    unchanged;      // Same id again, not uploaded.
+    uint64_t                    bursts;         // Ticks with frames to spare.
+    int64_t                     last_id;
+
+    // Current log window and the last completed one (shown in properties).
+    struct pipe_stats_window    window;
+    struct pipe_stats_window    last_window;
+    bool                        has_last_window;
+};
+
+typedef struct pipe_stats pipe_stats_t;
+
+void pipe_stats_init(pipe_stats_t *stats);
+void pipe_stats_free(pipe_stats_t *stats);
+void pipe_stats_reset(pipe_stats_t *stats);
+
+// `latency_ns` is the time from receive to upload, 0 if unknown.
+void pipe_stats_record_frame(pipe_stats_t *stats, int64_t id, size_t bytes, uint64_t latency_ns);
+void pipe_stats_record_upload(pipe_stats_t *stats, uint64_t upload_ns);
+void pipe_stats_record_unchanged(pipe_stats_t *stats);
+void pipe_stats_record_burst(pipe_stats_t *stats);
+
+// Rolls the window over and logs a summary once PIPE_STATS_LOG_INTERVAL_NS
+// has passed, call once per tick.
+void pipe_stats_tick(pipe_stats_t *stats, const char *name, uint64_t now);
+
+// Appends a human readable summary, one value per line, in the module's
+// locale.
+void pipe_stats_describe(pipe_stats_t *stats, struct dstr *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,623 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "pixel-convert.h"
+#include "plugin-support.h"
+
+#include <graphics/graphics.h>
+#include <util/base.h>
+#include <util/threading.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PIXEL_CONVERT_TARGET(isa)
+#else
+#define PIXEL_CONVERT_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define PIXEL_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+typedef void (*pixel_xor_fn)(uint8_t *dst, const uint8_t *src, const uint8_t *base, size_t size);
+
+struct pixel_convert_kernels {
+    const char                  *isa;
+    pixel_convert_fn            swap;
+    pixel_convert_fn            premultiply;
+    pixel_convert_fn            premultiply_swap;
+    pixel_convert_fn            expand;
+    pixel_convert_fn            expand_swap;
+    pixel_xor_fn                xor_bytes;
+};
+
+static pthread_once_t               kernels_once = PTHREAD_ONCE_INIT;
+static struct pixel_convert_kernels kernels;
+
+// [alpha][colour] -> premultiplied colour, in linear light.
+static uint8_t                      srgb_premultiply[256][256];
+
+// ========================================================================== //
+// C
+// ========================================================================== //
+
+// Rounded v / 255 for v <= 255 * 255.
+static inline uint8_t pixel_div255(uint32_t v)
+{
+    v += 128;
+    return (uint8_t)((v + (v >> 8)) >> 8);
+}
+
+static inline void pixel_swap_c(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; i++, dst += 4, src += 4) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = src[3];
+    }
+}
+
+static inline void pixel_premultiply_c(uint8_t *dst, const uint8_t *src, size_t pixels, bool swap)
+{
+    for (size_t i = 0; i < pixels; i++, dst += 4, src += 4) {
+        const uint32_t a = src[3];
+        dst[swap ? 2 : 0] = pixel_div255(src[0] * a);
+        dst[1]            = pixel_div255(src[1] * a);
+        dst[swap ? 0 : 2] = pixel_div255(src[2] * a);
+        dst[3]            = (uint8_t)a;
+    }
+}
+
+static inline void pixel_expand_c(uint8_t *dst, const uint8_t *src, size_t pixels, bool swap)
+{
+    for (size_t i = 0; i < pixels; i++, dst += 4, src += 3) {
+        dst[swap ? 2 : 0] = src[0];
+        dst[1]            = src[1];
+        dst[swap ? 0 : 2] = src[2];
+        dst[3]            = 255;
+    }
+}
+
+static inline void pixel_xor_c(uint8_t *dst, const uint8_t *src, const uint8_t *base, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        dst[i] = src[i] ^ base[i];
+    }
+}
+
+static void pixel_xor(uint8_t *dst, const uint8_t *src, const uint8_t *base, size_t size)
+{
+    pixel_xor_c(dst, src, base, size);
+}
+
+static void pixel_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_swap_c(dst, src, pixels);
+}
+
+static void pixel_premultiply(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_c(dst, src, pixels, false);
+}
+
+static void pixel_premultiply_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_c(dst, src, pixels, true);
+}
+
+static void pixel_expand(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_expand_c(dst, src, pixels, false);
+}
+
+static void pixel_expand_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_expand_c(dst, src, pixels, true);
+}
+
+static inline void pixel_premultiply_srgb_c(uint8_t *dst, const uint8_t *src, size_t pixels, bool swap)
+{
+    for (size_t i = 0; i < pixels; i++, dst += 4, src += 4) {
+        const uint8_t *lut = srgb_premultiply[src[3]];
+        dst[swap ? 2 : 0] = lut[src[0]];
+        dst[1]            = lut[src[1]];
+        dst[swap ? 0 : 2] = lut[src[2]];
+        dst[3]            = src[3];
+    }
+}
+
+static void pixel_premultiply_srgb(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_srgb_c(dst, src, pixels, false);
+}
+
+static void pixel_premultiply_srgb_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_srgb_c(dst, src, pixels, true);
+}
+
+#ifdef PIXEL_CONVERT_X86
+// ========================================================================== //
+// SSE2 / SSSE3
+// ========================================================================== //
+
+// Two pixels widened to 16 bits per channel. The alpha lanes multiply by 255
+// so they come out unchanged.
+PIXEL_CONVERT_TARGET("sse2")
+static inline __m128i pixel_premultiply_sse2_half(__m128i px, bool swap)
+{
+    const __m128i alpha_one = _mm_set1_epi64x(0x00FF000000000000LL);
+    const __m128i bias      = _mm_set1_epi16(128);
+
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, 0xFF), 0xFF);
+    a = _mm_or_si128(a, alpha_one);
+
+    __m128i v = _mm_add_epi16(_mm_mullo_epi16(px, a), bias);
+    v = _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+
+    if (swap) {
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+    }
+    return v;
+}
+
+PIXEL_CONVERT_TARGET("sse2")
+static inline void pixel_premultiply_sse2(uint8_t *dst, const uint8_t *src, size_t pixels, bool swap)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        const __m128i lo = pixel_premultiply_sse2_half(_mm_unpacklo_epi8(px, zero), swap);
+        const __m128i hi = pixel_premultiply_sse2_half(_mm_unpackhi_epi8(px, zero), swap);
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+
+    pixel_premultiply_c(dst + i * 4, src + i * 4, pixels - i, swap);
+}
+
+PIXEL_CONVERT_TARGET("sse2")
+static void pixel_premultiply_sse2_keep(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_sse2(dst, src, pixels, false);
+}
+
+PIXEL_CONVERT_TARGET("sse2")
+static void pixel_premultiply_sse2_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_sse2(dst, src, pixels, true);
+}
+
+PIXEL_CONVERT_TARGET("sse2")
+static void pixel_xor_sse2(uint8_t *dst, const uint8_t *src, const uint8_t *base, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(base + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(a, b));
+    }
+
+    pixel_xor_c(dst + i, src + i, base + i, size - i);
+}
+
+PIXEL_CONVERT_TARGET("sse2")
+static void pixel_swap_sse2(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    const __m128i ag = _mm_set1_epi32((int)0xFF00FF00);
+
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        const __m128i rb = _mm_andnot_si128(ag, px);
+        const __m128i br = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_or_si128(_mm_and_si128(px, ag), br));
+    }
+
+    pixel_swap_c(dst + i * 4, src + i * 4, pixels - i);
+}
+
+PIXEL_CONVERT_TARGET("ssse3")
+static void pixel_swap_ssse3(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_shuffle_epi8(px, mask));
+    }
+
+    pixel_swap_c(dst + i * 4, src + i * 4, pixels - i);
+}
+
+// Four pixels per 16 byte load, of which 12 bytes are used. The last loop
+// iteration must not read past the row, hence the two spare pixels.
+PIXEL_CONVERT_TARGET("ssse3")
+static inline void pixel_expand_ssse3(uint8_t *dst, const uint8_t *src, size_t pixels, bool swap)
+{
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    const __m128i mask  = swap
+        ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+        : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+    size_t i = 0;
+    for (; i + 6 <= pixels; i += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i *)(src + i * 3));
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(px, mask), alpha));
+    }
+
+    pixel_expand_c(dst + i * 4, src + i * 3, pixels - i, swap);
+}
+
+PIXEL_CONVERT_TARGET("ssse3")
+static void pixel_expand_ssse3_keep(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_expand_ssse3(dst, src, pixels, false);
+}
+
+PIXEL_CONVERT_TARGET("ssse3")
+static void pixel_expand_ssse3_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_expand_ssse3(dst, src, pixels, true);
+}
+
+// ========================================================================== //
+// AVX2
+// ========================================================================== //
+PIXEL_CONVERT_TARGET("avx2")
+static inline __m256i pixel_premultiply_avx2_half(__m256i px, bool swap)
+{
+    const __m256i alpha_one = _mm256_set1_epi64x(0x00FF000000000000LL);
+    const __m256i bias      = _mm256_set1_epi16(128);
+
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px, 0xFF), 0xFF);
+    a = _mm256_or_si256(a, alpha_one);
+
+    __m256i v = _mm256_add_epi16(_mm256_mullo_epi16(px, a), bias);
+    v = _mm256_srli_epi16(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+
+    if (swap) {
+        v = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+    }
+    return v;
+}
+
+// Unpack and pack both work within 128 bit lanes, so pixel order holds.
+PIXEL_CONVERT_TARGET("avx2")
+static inline void pixel_premultiply_avx2(uint8_t *dst, const uint8_t *src, size_t pixels, bool swap)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        const __m256i px = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+        const __m256i lo = pixel_premultiply_avx2_half(_mm256_unpacklo_epi8(px, zero), swap);
+        const __m256i hi = pixel_premultiply_avx2_half(_mm256_unpackhi_epi8(px, zero), swap);
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+
+    pixel_premultiply_c(dst + i * 4, src + i * 4, pixels - i, swap);
+}
+
+PIXEL_CONVERT_TARGET("avx2")
+static void pixel_premultiply_avx2_keep(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_avx2(dst, src, pixels, false);
+}
+
+PIXEL_CONVERT_TARGET("avx2")
+static void pixel_premultiply_avx2_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_avx2(dst, src, pixels, true);
+}
+
+PIXEL_CONVERT_TARGET("avx2")
+static void pixel_xor_avx2(uint8_t *dst, const uint8_t *src, const uint8_t *base, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(base + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(a, b));
+    }
+
+    pixel_xor_c(dst + i, src + i, base + i, size - i);
+}
+
+PIXEL_CONVERT_TARGET("avx2")
+static void pixel_swap_avx2(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    const __m256i mask = _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+    );
+
+    size_t i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        const __m256i px = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_shuffle_epi8(px, mask));
+    }
+
+    pixel_swap_c(dst + i * 4, src + i * 4, pixels - i);
+}
+
+// Each 128 bit lane expands four pixels loaded 12 bytes apart.
+PIXEL_CONVERT_TARGET("avx2")
+static inline void pixel_expand_avx2(uint8_t *dst, const uint8_t *src, size_t pixels, bool swap)
+{
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i mask  = swap
+        ? _mm256_setr_epi8(
+            2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+            2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+        : _mm256_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+    size_t i = 0;
+    for (; i + 10 <= pixels; i += 8) {
+        const __m128i lo = _mm_loadu_si128((const __m128i *)(src + i * 3));
+        const __m128i hi = _mm_loadu_si128((const __m128i *)(src + i * 3 + 12));
+        const __m256i px = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(px, mask), alpha));
+    }
+
+    pixel_expand_c(dst + i * 4, src + i * 3, pixels - i, swap);
+}
+
+PIXEL_CONVERT_TARGET("avx2")
+static void pixel_expand_avx2_keep(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_expand_avx2(dst, src, pixels, false);
+}
+
+PIXEL_CONVERT_TARGET("avx2")
+static void pixel_expand_avx2_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_expand_avx2(dst, src, pixels, true);
+}
+
+static bool pixel_convert_has_ssse3(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static bool pixel_convert_has_avx2(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+
+    // The OS has to save the YMM registers too.
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // PIXEL_CONVERT_X86
+
+#ifdef PIXEL_CONVERT_NEON
+// ========================================================================== //
+// NEON
+// ========================================================================== //
+
+// Rounded c * a / 255, same result as pixel_div255.
+static inline uint8x16_t pixel_mul_neon(uint8x16_t c, uint8x16_t a)
+{
+    const uint16x8_t lo = vmull_u8(vget_low_u8(c),  vget_low_u8(a));
+    const uint16x8_t hi = vmull_u8(vget_high_u8(c), vget_high_u8(a));
+    return vcombine_u8(
+        vraddhn_u16(lo, vrshrq_n_u16(lo, 8)),
+        vraddhn_u16(hi, vrshrq_n_u16(hi, 8))
+    );
+}
+
+static inline void pixel_premultiply_neon(uint8_t *dst, const uint8_t *src, size_t pixels, bool swap)
+{
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        const uint8x16x4_t px = vld4q_u8(src + i * 4);
+        const uint8x16_t   c0 = pixel_mul_neon(px.val[0], px.val[3]);
+        const uint8x16_t   c2 = pixel_mul_neon(px.val[2], px.val[3]);
+
+        uint8x16x4_t out;
+        out.val[0] = swap ? c2 : c0;
+        out.val[1] = pixel_mul_neon(px.val[1], px.val[3]);
+        out.val[2] = swap ? c0 : c2;
+        out.val[3] = px.val[3];
+        vst4q_u8(dst + i * 4, out);
+    }
+
+    pixel_premultiply_c(dst + i * 4, src + i * 4, pixels - i, swap);
+}
+
+static void pixel_premultiply_neon_keep(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_neon(dst, src, pixels, false);
+}
+
+static void pixel_premultiply_neon_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_premultiply_neon(dst, src, pixels, true);
+}
+
+static void pixel_xor_neon(uint8_t *dst, const uint8_t *src, const uint8_t *base, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), vld1q_u8(base + i)));
+    }
+
+    pixel_xor_c(dst + i, src + i, base + i, size - i);
+}
+
+static void pixel_swap_neon(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x16x4_t     px = vld4q_u8(src + i * 4);
+        const uint8x16_t c0 = px.val[0];
+        px.val[0] = px.val[2];
+        px.val[2] = c0;
+        vst4q_u8(dst + i * 4, px);
+    }
+
+    pixel_swap_c(dst + i * 4, src + i * 4, pixels - i);
+}
+
+static inline void pixel_expand_neon(uint8_t *dst, const uint8_t *src, size_t pixels, bool swap)
+{
+    size_t i = 0;
+    for (; i + 16 <= pixels; i += 16) {
+        const uint8x16x3_t px = vld3q_u8(src + i * 3);
+
+        uint8x16x4_t out;
+        out.val[0] = swap ? px.val[2] : px.val[0];
+        out.val[1] = px.val[1];
+        out.val[2] = swap ? px.val[0] : px.val[2];
+        out.val[3] = vdupq_n_u8(255);
+        vst4q_u8(dst + i * 4, out);
+    }
+
+    pixel_expand_c(dst + i * 4, src + i * 3, pixels - i, swap);
+}
+
+static void pixel_expand_neon_keep(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_expand_neon(dst, src, pixels, false);
+}
+
+static void pixel_expand_neon_swap(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+    pixel_expand_neon(dst, src, pixels, true);
+}
+#endif // PIXEL_CONVERT_NEON
+
+// ========================================================================== //
+// Dispatch
+// ========================================================================== //
+static void pixel_convert_init(void)
+{
+    for (uint32_t a = 0; a < 256; a++) {
+        for (uint32_t c = 0; c < 256; c++) {
+            const float linear = gs_srgb_nonlinear_to_linear((float)c / 255.0f) * (float)a / 255.0f;
+            srgb_premultiply[a][c] = (uint8_t)(gs_srgb_linear_to_nonlinear(linear) * 255.0f + 0.5f);
+        }
+    }
+
+    kernels.isa              = "C";
+    kernels.swap             = pixel_swap;
+    kernels.premultiply      = pixel_premultiply;
+    kernels.premultiply_swap = pixel_premultiply_swap;
+    kernels.expand           = pixel_expand;
+    kernels.expand_swap      = pixel_expand_swap;
+    kernels.xor_bytes        = pixel_xor;
+
+#ifdef PIXEL_CONVERT_X86
+    if (pixel_convert_has_avx2()) {
+        kernels.isa              = "AVX2";
+        kernels.swap             = pixel_swap_avx2;
+        kernels.premultiply      = pixel_premultiply_avx2_keep;
+        kernels.premultiply_swap = pixel_premultiply_avx2_swap;
+        kernels.expand           = pixel_expand_avx2_keep;
+        kernels.expand_swap      = pixel_expand_avx2_swap;
+        kernels.xor_bytes        = pixel_xor_avx2;
+    } else if (pixel_convert_has_ssse3()) {
+        kernels.isa              = "SSSE3";
+        kernels.swap             = pixel_swap_ssse3;
+        kernels.premultiply      = pixel_premultiply_sse2_keep;
+        kernels.premultiply_swap = pixel_premultiply_sse2_swap;
+        kernels.expand           = pixel_expand_ssse3_keep;
+        kernels.expand_swap      = pixel_expand_ssse3_swap;
+        kernels.xor_bytes        = pixel_xor_sse2;
+    } else {
+        kernels.isa              = "SSE2";
+        kernels.swap             = pixel_swap_sse2;
+        kernels.premultiply      = pixel_premultiply_sse2_keep;
+        kernels.premultiply_swap = pixel_premultiply_sse2_swap;
+        kernels.xor_bytes        = pixel_xor_sse2;
+    }
+#elif defined(PIXEL_CONVERT_NEON)
+    kernels.isa              = "NEON";
+    kernels.swap             = pixel_swap_neon;
+    kernels.premultiply      = pixel_premultiply_neon_keep;
+    kernels.premultiply_swap = pixel_premultiply_neon_swap;
+    kernels.expand           = pixel_expand_neon_keep;
+    kernels.expand_swap      = pixel_expand_neon_swap;
+    kernels.xor_bytes        = pixel_xor_neon;
+#endif
+
+    obs_log(LOG_INFO, "pixel conversion using %s kernels", kernels.isa);
+}
+
+pixel_convert_fn pixel_convert_get(uint32_t src_bpp, bool swap_rb, enum pixel_convert_alpha alpha)
+{
+    pthread_once(&kernels_once, pixel_convert_init);
+
+    if (src_bpp == 3) {
+        return swap_rb ? kernels.expand_swap : kernels.expand;
+    }
+
+    switch (alpha) {
+    case PIXEL_CONVERT_ALPHA_PREMULTIPLY:
+        return swap_rb ? kernels.premultiply_swap : kernels.premultiply;
+    case PIXEL_CONVERT_ALPHA_PREMULTIPLY_SRGB:
+        return swap_rb ? pixel_premultiply_srgb_swap : pixel_premultiply_srgb;
+    case PIXEL_CONVERT_ALPHA_KEEP:
+        break;
+    }
+
+    return swap_rb ? kernels.swap : NULL;
+}
+
+void pixel_convert_xor(uint8_t *dst, const uint8_t *src, const uint8_t *base, size_t size)
+{
+    pthread_once(&kernels_once, pixel_convert_init);
+    kernels.xor_bytes(dst, src, base, size);
+}
+
+const char *pixel_convert_isa(void)
+{
+    pthread_once(&kernels_once, pixel_convert_init);
+    return kernels.isa;
+}
@@ -0,0 +1,64 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================================================== //
+// Pixel conversion
+//
+// Row kernels that turn incoming pixels into 4 byte pixels the texture can
+// take as is. They run while frames are copied out of the eCAL message, so
+// converting costs no extra pass over memory. 4 byte pixels may be converted
+// in place, 3 byte pixels need a separate destination.
+//
+// The kernels are picked at runtime: AVX2 or SSSE3 and SSE2 on x86, NEON on
+// ARM64, plain C otherwise. Premultiplying in linear light goes through a
+// lookup table on every architecture.
+// ========================================================================== //
+
+enum pixel_convert_alpha {
+    PIXEL_CONVERT_ALPHA_KEEP            = 0,
+    // Straight to premultiplied alpha on the stored (sRGB) values.
+    PIXEL_CONVERT_ALPHA_PREMULTIPLY     = 1,
+    // Straight to premultiplied alpha in linear light, like
+    // GS_IMAGE_ALPHA_PREMULTIPLY_SRGB.
+    PIXEL_CONVERT_ALPHA_PREMULTIPLY_SRGB = 2,
+};
+
+typedef void (*pixel_convert_fn)(uint8_t *dst, const uint8_t *src, size_t pixels);
+
+// Kernel reading `src_bpp` (3 or 4) byte pixels and writing 4 byte pixels.
+// `swap_rb` exchanges the first and third channel, 3 byte pixels get an
+// opaque alpha. Returns NULL when a plain copy would do.
+pixel_convert_fn pixel_convert_get(uint32_t src_bpp, bool swap_rb, enum pixel_convert_alpha alpha);
+
+// dst = src ^ base over `size` bytes, for delta frames. `dst` may be `src`.
+void pixel_convert_xor(uint8_t *dst, const uint8_t *src, const uint8_t *base, size_t size);
+
+// Name of the instruction set the kernels use.
+const char *pixel_convert_isa(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,184 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "pixel-pool.h"
+
+#include <util/base.h>
+#include <util/threading.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#define PIXEL_POOL_ALIGN        4096
+#define PIXEL_POOL_MIN_SHIFT    16                  // 64 KiB
+#define PIXEL_POOL_STEPS        4                   // Classes per power of two.
+#define PIXEL_POOL_CLASSES      (15 * PIXEL_POOL_STEPS) // Up to 2 GiB.
+#define PIXEL_POOL_KEEP         4                   // Cached buffers per class.
+#define PIXEL_POOL_MAX_CACHED   ((size_t)512 << 20)
+
+struct pixel_pool_class {
+    uint8_t                     *buffers[PIXEL_POOL_KEEP];
+    size_t                      count;
+};
+
+static struct {
+    pthread_mutex_t             mutex;
+    struct pixel_pool_class     classes[PIXEL_POOL_CLASSES];
+    size_t                      cached;
+    volatile long               misses;
+} pool = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static inline size_t pixel_pool_class_size(size_t index)
+{
+    const size_t octave = index / PIXEL_POOL_STEPS;
+    const size_t step   = index % PIXEL_POOL_STEPS;
+    return (PIXEL_POOL_STEPS + step) << (PIXEL_POOL_MIN_SHIFT - 2 + octave);
+}
+
+// Smallest class holding `size`, PIXEL_POOL_CLASSES if none does.
+static size_t pixel_pool_class_index(size_t size)
+{
+    size_t index = 0;
+    while (index < PIXEL_POOL_CLASSES && pixel_pool_class_size(index) < size) {
+        index++;
+    }
+    return index;
+}
+
+// Like bmalloc, running out of memory is fatal.
+static uint8_t *pixel_pool_aligned_alloc(size_t size)
+{
+    void *data = NULL;
+
+#ifdef _WIN32
+    data = _aligned_malloc(size, PIXEL_POOL_ALIGN);
+#else
+    if (posix_memalign(&data, PIXEL_POOL_ALIGN, size) != 0) {
+        data = NULL;
+    }
+#endif
+
+    if (!data) {
+        bcrash("pixel pool: out of memory while allocating %zu bytes", size);
+    }
+    return (uint8_t *)data;
+}
+
+static void pixel_pool_aligned_free(uint8_t *data)
+{
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+uint8_t *pixel_pool_alloc(size_t size, size_t *capacity)
+{
+    const size_t index = pixel_pool_class_index(size);
+
+    if (index == PIXEL_POOL_CLASSES) {
+        os_atomic_inc_long(&pool.misses);
+        *capacity = size;
+        return pixel_pool_aligned_alloc(size);
+    }
+
+    const size_t class_size = pixel_pool_class_size(index);
+
+    pthread_mutex_lock(&pool.mutex);
+    struct pixel_pool_class *class = &pool.classes[index];
+    if (class->count > 0) {
+        uint8_t *data = class->buffers[--class->count];
+        pool.cached -= class_size;
+        pthread_mutex_unlock(&pool.mutex);
+
+        *capacity = class_size;
+        return data;
+    }
+    pthread_mutex_unlock(&pool.mutex);
+
+    os_atomic_inc_long(&pool.misses);
+
+    *capacity = class_size;
+    return pixel_pool_aligned_alloc(class_size);
+}
+
+void pixel_pool_free(uint8_t *data, size_t capacity)
+{
+    if (!data) {
+        return;
+    }
+
+    const size_t index = pixel_pool_class_index(capacity);
+
+    if (index < PIXEL_POOL_CLASSES && pixel_pool_class_size(index) == capacity) {
+        pthread_mutex_lock(&pool.mutex);
+        struct pixel_pool_class *class = &pool.classes[index];
+        if (class->count < PIXEL_POOL_KEEP && pool.cached + capacity <= PIXEL_POOL_MAX_CACHED) {
+            class->buffers[class->count++] = data;
+            pool.cached += capacity;
+            data = NULL;
+        }
+        pthread_mutex_unlock(&pool.mutex);
+    }
+
+    pixel_pool_aligned_free(data);
+}
+
+uint8_t *pixel_pool_grow(uint8_t **data, size_t *capacity, size_t used, size_t size)
+{
+    if (*data && *capacity >= size) {
+        return *data;
+    }
+
+    size_t  new_capacity = 0;
+    uint8_t *new_data    = pixel_pool_alloc(size, &new_capacity);
+
+    if (*data && used > 0) {
+        memcpy(new_data, *data, used < size ? used : size);
+    }
+
+    pixel_pool_free(*data, *capacity);
+    *data     = new_data;
+    *capacity = new_capacity;
+    return new_data;
+}
+
+void pixel_pool_trim(void)
+{
+    pthread_mutex_lock(&pool.mutex);
+    for (size_t i = 0; i < PIXEL_POOL_CLASSES; i++) {
+        struct pixel_pool_class *class = &pool.classes[i];
+        while (class->count > 0) {
+            pixel_pool_aligned_free(class->buffers[--class->count]);
+        }
+    }
+    pool.cached = 0;
+    pthread_mutex_unlock(&pool.mutex);
+}
+
+long pixel_pool_misses(void)
+{
+    return os_atomic_load_long(&pool.misses);
+}
@@ -0,0 +1,53 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================================================== //
+// Pixel pool
+//
+// Module-wide pool of page-aligned buffers for frame pixels, shared by all
+// sources. Sizes are rounded up to one of four classes per power of two
+// (at most 25% slack), freed buffers are kept per class so a publisher
+// switching between a few resolutions stops allocating after the first
+// round. Buffers above the largest class are not pooled.
+//
+// A buffer must be freed with the capacity it was allocated with.
+// ========================================================================== //
+
+uint8_t *pixel_pool_alloc(size_t size, size_t *capacity);
+void pixel_pool_free(uint8_t *data, size_t capacity);
+
+// Makes `*data` hold at least `size` bytes, keeping the first `used` bytes.
+uint8_t *pixel_pool_grow(uint8_t **data, size_t *capacity, size_t used, size_t size);
+
+// Releases every cached buffer, call on module unload.
+void pixel_pool_trim(void);
+
+// Buffers that had to be allocated because no cached one was free.
+long pixel_pool_misses(void);
+
+#ifdef __cplusplus
+}
+#endif
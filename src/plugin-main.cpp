@@ -23,12 +23,13 @@
 #include <sys/stat.h>
 
 #include <ecal/ecal.h>
-#include <ecal/msg/protobuf/subscriber.h>
 
+#include "decode-pool.h"
 #include "frame-manager.h"
-#include "image-buffer.h"
 #include "graphics-custom.h"
-#include "proto/frame.pb.h"
+#include "pipe-output.h"
+#include "pipe-registry.h"
+#include "pixel-pool.h"
 
 
 //#define SHOW_TRACE 1
@@ -44,23 +45,25 @@
 // Structures
 // ========================================================================== //
 
-typedef eCAL::protobuf::CSubscriber<ObsPipe::Proto::Frame> obs_pipe_subscriber_t;
-typedef ObsPipe::Proto::Frame obs_pipe_frame_t;
-
 struct pipe_source_t {
     obs_source_t            *source;
+    bool                    async;
 
     char                    *pipe_name;
     bool                    persistent;
     bool                    linear_alpha;
-    
-    bool                    loaded;
-    int                     last_frame_id;
-    int64_t                 last_seen;
 
-    gs_image_buffer_t       image;
-    obs_pipe_subscriber_t   subscriber;
-    obs_pipe_frame_t        frame;
+    // Receive and upload from video_render instead of the tick, so a source
+    // that is never drawn costs no upload. Sync sources only.
+    bool                    lazy_upload;
+
+    // Sync sources draw from a pipe shared with every source watching it,
+    // `using_pipe` is set while this one counts as a user of its texture.
+    pipe_shared_t           *pipe;
+    bool                    using_pipe;
+
+    // Async sources output frames straight from their own receiver.
+    frame_manager_t         receiver;
 };
 
 typedef pipe_source_t pipe_source_t;
@@ -99,38 +102,20 @@ static void pipe_source_load(pipe_source_t *context)
 {
     TRACE("pipe_source_load()");
 
-    if (eCAL::Ok()) {
-        // Receive frame.
-        ObsPipe::Proto::Frame& frame = context->frame;
-        bool recv = context->subscriber.Receive(frame);
-        if (recv) {
-            TRACE("loading frame: %d", frame.id());
-            
-            // Load image received from subscriber.
-            gs_image_buffer_init_from_raw_pixels(
-                &context->image,
-                (uint8_t *)frame.buffer().data(),
-                frame.buffer().size(),
-                frame.width(),
-                frame.height(),
-                GS_BGRA,
-                context->linear_alpha
-                    ? GS_IMAGE_ALPHA_PREMULTIPLY_SRGB
-                    : GS_IMAGE_ALPHA_PREMULTIPLY,
-                GS_CS_SRGB
-            );
-            context->last_frame_id = context->frame.id();
-        
-            // Init texture.
-            obs_enter_graphics();
-            gs_image_buffer_init_texture(&context->image);
-            obs_leave_graphics();
-
-            if (!context->loaded) {
-                obs_log(LOG_WARNING, "failed to load texture");
-                context->loaded = false;
-            }
-        }
+    if (!context->pipe) {
+        return;
+    }
+
+    if (!context->using_pipe) {
+        pipe_shared_use(context->pipe);
+        context->using_pipe = true;
+    }
+
+    // Lazy sources still load on tick until they have a size, libobs does
+    // not render sources that report 0x0.
+    const struct gs_image_buffer *image = &context->pipe->image;
+    if (!context->lazy_upload || !image->texture || !image->width || !image->height) {
+        pipe_shared_load(context->pipe, obs_get_video_frame_time());
     }
 }
 
@@ -138,9 +123,10 @@ static void pipe_source_unload(pipe_source_t *context)
 {
     TRACE("pipe_source_unload()");
 
-    obs_enter_graphics();
-    gs_image_buffer_free(&context->image);
-    obs_leave_graphics();
+    if (context->using_pipe) {
+        pipe_shared_unuse(context->pipe);
+        context->using_pipe = false;
+    }
 }
 
 static const char *pipe_source_get_name(void *unused)
@@ -151,12 +137,20 @@ static const char *pipe_source_get_name(void *unused)
     return obs_module_text("Pipe Source");
 }
 
+static const char *pipe_source_async_get_name(void *unused)
+{
+    UNUSED_PARAMETER(unused);
+
+    TRACE("pipe_source_async_get_name()");
+    return obs_module_text("Pipe Source (Async)");
+}
+
 static uint32_t pipe_source_get_width(void *data)
 {
     pipe_source_t *context = (pipe_source_t *)data;
 
     TRACE("pipe_source_get_width()");
-    return context->image.width;
+    return context->pipe ? context->pipe->image.width : 0;
 }
 
 static uint32_t pipe_source_get_height(void *data)
@@ -164,7 +158,7 @@ static uint32_t pipe_source_get_height(void *data)
     pipe_source_t *context = (pipe_source_t *)data;
 
     TRACE("pipe_source_get_height()");
-    return context->image.height;
+    return context->pipe ? context->pipe->image.height : 0;
 }
 
 static void pipe_source_get_defaults(obs_data_t *settings)
@@ -173,7 +167,33 @@ static void pipe_source_get_defaults(obs_data_t *settings)
 
     obs_data_set_default_string(settings, "pipe_name", "");
     obs_data_set_default_bool(settings, "unload", false);
+    obs_data_set_default_bool(settings, "straight_alpha", false);
     obs_data_set_default_bool(settings, "linear_alpha", false);
+    obs_data_set_default_bool(settings, "gpu_convert", false);
+    obs_data_set_default_bool(settings, "lazy_upload", false);
+    obs_data_set_default_int(settings, "receive_mode", FRAME_RECEIVE_CALLBACK);
+    obs_data_set_default_int(settings, "transport", FRAME_TRANSPORT_AUTO);
+    obs_data_set_default_int(settings, "pacing", FRAME_PACING_LATEST);
+    obs_data_set_default_int(settings, "jitter_delay_ms", 50);
+}
+
+static bool pipe_source_stats_refresh(obs_properties_t *props, obs_property_t *property, void *data)
+{
+    UNUSED_PARAMETER(props);
+    UNUSED_PARAMETER(property);
+    UNUSED_PARAMETER(data);
+
+    // Rebuilds the properties, which re-reads the stats.
+    return true;
+}
+
+static bool pipe_source_pacing_modified(obs_properties_t *props, obs_property_t *property, obs_data_t *settings)
+{
+    UNUSED_PARAMETER(property);
+
+    const auto pacing = (enum frame_pacing)obs_data_get_int(settings, "pacing");
+    obs_property_set_visible(obs_properties_get(props, "jitter_delay_ms"), pacing == FRAME_PACING_JITTER_BUFFER);
+    return true;
 }
 
 static obs_properties_t *pipe_source_get_properties(void *data)
@@ -186,6 +206,78 @@ static obs_properties_t *pipe_source_get_properties(void *data)
     obs_properties_add_text(props, "pipe_name", obs_module_text("PipeName"), OBS_TEXT_DEFAULT);
     obs_properties_add_bool(props, "unload", obs_module_text("UnloadWhenNotShowing"));
     obs_properties_add_bool(props, "linear_alpha", obs_module_text("LinearAlpha"));
+
+    // libobs takes straight alpha from async sources as is.
+    if (!context || !context->async) {
+        obs_properties_add_bool(props, "straight_alpha", obs_module_text("StraightAlpha"));
+
+        obs_property_t *gpu_convert = obs_properties_add_bool(props, "gpu_convert", obs_module_text("GpuConvert"));
+        obs_property_set_long_description(gpu_convert, obs_module_text("GpuConvert.Description"));
+
+        obs_property_t *lazy_upload = obs_properties_add_bool(props, "lazy_upload", obs_module_text("LazyUpload"));
+        obs_property_set_long_description(lazy_upload, obs_module_text("LazyUpload.Description"));
+    }
+
+    // Async sources always receive on the eCAL thread.
+    if (!context || !context->async) {
+        obs_property_t *receive_mode = obs_properties_add_list(
+            props,
+            "receive_mode",
+            obs_module_text("ReceiveMode"),
+            OBS_COMBO_TYPE_LIST,
+            OBS_COMBO_FORMAT_INT
+        );
+        obs_property_list_add_int(receive_mode, obs_module_text("ReceiveMode.Callback"), FRAME_RECEIVE_CALLBACK);
+        obs_property_list_add_int(receive_mode, obs_module_text("ReceiveMode.Poll"),     FRAME_RECEIVE_POLL);
+
+        obs_property_t *pacing = obs_properties_add_list(
+            props,
+            "pacing",
+            obs_module_text("Pacing"),
+            OBS_COMBO_TYPE_LIST,
+            OBS_COMBO_FORMAT_INT
+        );
+        obs_property_list_add_int(pacing, obs_module_text("Pacing.Latest"),       FRAME_PACING_LATEST);
+        obs_property_list_add_int(pacing, obs_module_text("Pacing.JitterBuffer"), FRAME_PACING_JITTER_BUFFER);
+        obs_property_list_add_int(pacing, obs_module_text("Pacing.RateConvert"),  FRAME_PACING_RATE_CONVERT);
+        obs_property_set_long_description(pacing, obs_module_text("Pacing.Description"));
+        obs_property_set_modified_callback(pacing, pipe_source_pacing_modified);
+
+        obs_property_t *delay = obs_properties_add_int_slider(
+            props,
+            "jitter_delay_ms",
+            obs_module_text("JitterDelay"),
+            0,
+            500,
+            1
+        );
+        obs_property_int_set_suffix(delay, " ms");
+    }
+
+    obs_property_t *transport = obs_properties_add_list(
+        props,
+        "transport",
+        obs_module_text("Transport"),
+        OBS_COMBO_TYPE_LIST,
+        OBS_COMBO_FORMAT_INT
+    );
+    obs_property_list_add_int(transport, obs_module_text("Transport.Auto"),     FRAME_TRANSPORT_AUTO);
+    obs_property_list_add_int(transport, obs_module_text("Transport.Protobuf"), FRAME_TRANSPORT_PROTOBUF);
+    obs_property_list_add_int(transport, obs_module_text("Transport.Raw"),      FRAME_TRANSPORT_RAW);
+
+    // Frames only reach pipe_source_load on sync sources. Stats are shared
+    // by every source on the same pipe.
+    if (context && context->pipe) {
+        struct dstr text = {};
+        pipe_stats_describe(&context->pipe->stats, &text);
+
+        obs_properties_t *stats = obs_properties_create();
+        obs_properties_add_text(stats, "stats_info", text.array, OBS_TEXT_INFO);
+        obs_properties_add_button(stats, "stats_refresh", obs_module_text("Stats.Refresh"), pipe_source_stats_refresh);
+        obs_properties_add_group(props, "stats", obs_module_text("Stats"), OBS_GROUP_NORMAL, stats);
+
+        dstr_free(&text);
+    }
     
     return props;
 }
@@ -198,7 +290,14 @@ static void pipe_source_update(void *data, obs_data_t *settings)
 
     const char  *pipe_name    = obs_data_get_string(settings, "pipe_name");
     const bool  unload        = obs_data_get_bool  (settings, "unload");
+    const bool  straight      = obs_data_get_bool  (settings, "straight_alpha");
     const bool  linear_alpha  = obs_data_get_bool  (settings, "linear_alpha");
+    const bool  gpu_convert   = obs_data_get_bool  (settings, "gpu_convert");
+    const bool  lazy_upload   = obs_data_get_bool  (settings, "lazy_upload");
+    const auto  receive_mode  = (enum frame_receive_mode)obs_data_get_int(settings, "receive_mode");
+    const auto  transport     = (enum frame_transport)obs_data_get_int(settings, "transport");
+    const auto  pacing        = (enum frame_pacing)obs_data_get_int(settings, "pacing");
+    const auto  jitter_delay  = (uint32_t)obs_data_get_int(settings, "jitter_delay_ms");
 
     if (context->pipe_name) {
         bfree(context->pipe_name);
@@ -206,18 +305,49 @@ static void pipe_source_update(void *data, obs_data_t *settings)
     context->pipe_name      = bstrdup(pipe_name);
     context->persistent     = !unload;
     context->linear_alpha   = linear_alpha;
-    context->last_frame_id  = -1;
-    context->loaded         = false;
-    context->last_seen      = 0;
+    context->lazy_upload    = lazy_upload && !context->async;
+
+    if (context->async) {
+        frame_manager_config_t config = {};
+        config.pipe_name    = pipe_name;
+        config.mode         = receive_mode;
+        config.transport    = transport;
+        config.async_output = context->source;
+
+        // Hidden sources that unload subscribe on show.
+        context->receiver.paused = !context->persistent && !obs_source_showing(context->source);
+        frame_manager_open(&context->receiver, &config);
+        return;
+    }
 
-    obs_log(LOG_INFO, "creating subscriber");
-    if (context->subscriber.IsCreated()) {
-        context->subscriber.Destroy();
+    pipe_shared_config_t config = {};
+    config.pipe_name       = pipe_name;
+    config.mode            = receive_mode;
+    config.transport       = transport;
+    config.pacing          = pacing;
+    config.jitter_delay_ms = jitter_delay;
+    config.straight_alpha  = straight;
+    config.linear_alpha    = linear_alpha;
+    config.gpu_convert     = gpu_convert;
+
+    pipe_shared_t *pipe = pipe_registry_acquire(&config);
+    pipe_stats_reset(&pipe->stats);
+
+    // Unchanged key: same pipe, its subscriber and use count stay as they are.
+    if (pipe == context->pipe) {
+        pipe_registry_release(pipe);
+        return;
     }
-    if (strlen(pipe_name) > 0)
-    {
-        context->subscriber.Create(pipe_name);
+
+    // Move the use over before releasing, the new pipe subscribes right away
+    // and the old one only pauses if no other source uses it.
+    if (context->using_pipe) {
+        pipe_shared_use(pipe);
+        pipe_shared_unuse(context->pipe);
     }
+
+    pipe_registry_release(context->pipe);
+    context->pipe = pipe;
 }
 
 static void *pipe_source_create(obs_data_t *settings, obs_source_t *source)
@@ -232,15 +362,29 @@ static void *pipe_source_create(obs_data_t *settings, obs_source_t *source)
     return context;
 }
 
+static void *pipe_source_async_create(obs_data_t *settings, obs_source_t *source)
+{
+    TRACE("pipe_source_async_create()");
+
+    pipe_source_t *context = new pipe_source_t();
+
+    context->source = source;
+    context->async  = true;
+    pipe_source_update(context, settings);
+
+    return context;
+}
+
 static void pipe_source_destroy(void *data)
 {
     pipe_source_t *context = (pipe_source_t *)data;
 
     TRACE("pipe_source_destroy()");
 
-    context->subscriber.Destroy();
+    frame_manager_close(&context->receiver);
 
     pipe_source_unload(context);
+    pipe_registry_release(context->pipe);
 
     if (context->pipe_name) {
         bfree(context->pipe_name);
@@ -270,7 +414,11 @@ static void pipe_source_show(void *data)
     TRACE("pipe_source_show()");
 
     if (!context->persistent) {
-        pipe_source_load(context);
+        if (context->async) {
+            frame_manager_resume(&context->receiver);
+        } else {
+            pipe_source_load(context);
+        }
     }
 }
 
@@ -281,7 +429,12 @@ static void pipe_source_hide(void *data)
     TRACE("pipe_source_hide()");
 
     if (!context->persistent) {
-        pipe_source_unload(context);
+        if (context->async) {
+            frame_manager_pause(&context->receiver);
+            obs_source_output_video(context->source, NULL);
+        } else {
+            pipe_source_unload(context);
+        }
     }
 }
 
@@ -291,22 +444,44 @@ static void pipe_source_tick(void *data, float seconds)
 
     TRACE("pipe_source_tick()");
 
+    // Hidden sources only drop their use of the pipe once, after that a
+    // tick costs nothing.
     if (context->persistent || obs_source_showing(context->source)) {
         pipe_source_load(context);
     } else {
-        pipe_source_unload(context);
+        if (context->using_pipe) {
+            pipe_source_unload(context);
+        }
+        return;
+    }
+
+    if (context->pipe) {
+        pipe_stats_tick(&context->pipe->stats, context->pipe->pipe_name.c_str(), os_gettime_ns());
     }
 }
 
+// Custom draw: the image picks its own effect, straight alpha frames are
+// premultiplied by a shader.
 static void pipe_source_render(void *data, gs_effect_t *effect)
 {
     pipe_source_t *context = (pipe_source_t *)data;
 
+    UNUSED_PARAMETER(effect);
+
     TRACE("pipe_source_render()");
 
-    struct gs_image_buffer *const image = &context->image;
-    gs_texture_t *const texture = image->texture;
-    if (!texture) {
+    if (!context->pipe) {
+        return;
+    }
+
+    // First render of this video frame, across all sources on the pipe,
+    // picks up the newest frame. Until then it waits in the mailbox.
+    if (context->lazy_upload && context->using_pipe) {
+        pipe_shared_load(context->pipe, obs_get_video_frame_time());
+    }
+
+    struct gs_image_buffer *const image = &context->pipe->image;
+    if (!image->texture) {
         return;
     }
 
@@ -316,10 +491,7 @@ static void pipe_source_render(void *data, gs_effect_t *effect)
     gs_blend_state_push();
     gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
 
-    gs_eparam_t *const param = gs_effect_get_param_by_name(effect, "image");
-    gs_effect_set_texture_srgb(param, texture);
-
-    gs_draw_sprite(texture, 0, image->width, image->height);
+    gs_image_buffer_draw(image);
 
     gs_blend_state_pop();
 
@@ -331,15 +503,15 @@ static enum gs_color_space pipe_source_get_color_space(
     size_t                      count,
     const enum gs_color_space   *preferred_spaces
 ) {
-    pipe_source_t      *const context = (pipe_source_t *)data;
-    gs_image_buffer_t  *const image   = &context->image;
+    pipe_source_t *const context = (pipe_source_t *)data;
 
     UNUSED_PARAMETER(count);
     UNUSED_PARAMETER(preferred_spaces);
 
     TRACE("pipe_source_get_color_space()");
 
-    return image->texture ? image->color_space : GS_CS_SRGB;
+    const gs_image_buffer_t *const image = context->pipe ? &context->pipe->image : NULL;
+    return image && image->texture ? image->color_space : GS_CS_SRGB;
 }
 
 static struct obs_source_info pipe_source_info_init()
@@ -348,7 +520,7 @@ static struct obs_source_info pipe_source_info_init()
 
     pipe_source_info.id                     = "pipe_source";
     pipe_source_info.type                   = OBS_SOURCE_TYPE_INPUT;
-    pipe_source_info.output_flags           = OBS_SOURCE_VIDEO | OBS_SOURCE_SRGB;
+    pipe_source_info.output_flags           = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW | OBS_SOURCE_SRGB;
     pipe_source_info.get_name               = pipe_source_get_name;
     pipe_source_info.create                 = pipe_source_create;
     pipe_source_info.destroy                = pipe_source_destroy;
@@ -369,6 +541,26 @@ static struct obs_source_info pipe_source_info_init()
     return pipe_source_info;
 }
 
+// libobs fixes output flags per source type, so the async presentation mode
+// is its own type sharing everything but rendering with the sync source. It
+// also plays audio sent over the pipe, synced to the frames by timestamp.
+static struct obs_source_info pipe_source_async_info_init()
+{
+    static struct obs_source_info pipe_source_async_info = pipe_source_info_init();
+
+    pipe_source_async_info.id                     = "pipe_source_async";
+    pipe_source_async_info.output_flags           = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO;
+    pipe_source_async_info.get_name               = pipe_source_async_get_name;
+    pipe_source_async_info.create                 = pipe_source_async_create;
+    pipe_source_async_info.get_width              = NULL;
+    pipe_source_async_info.get_height             = NULL;
+    pipe_source_async_info.video_tick             = NULL;
+    pipe_source_async_info.video_render           = NULL;
+    pipe_source_async_info.video_get_color_space  = NULL;
+
+    return pipe_source_async_info;
+}
+
 // ========================================================================== //
 // Module
 // ========================================================================== //
@@ -382,7 +574,9 @@ MODULE_EXPORT const char *obs_module_description(void)
 
 bool obs_module_load(void)
 {
-    struct obs_source_info pipe_source_info = pipe_source_info_init();
+    struct obs_source_info pipe_source_info       = pipe_source_info_init();
+    struct obs_source_info pipe_source_async_info = pipe_source_async_info_init();
+    struct obs_source_info pipe_output_filter_info = pipe_output_filter_info_init();
 
     TRACE("obs_module_load()");
 
@@ -390,11 +584,21 @@ bool obs_module_load(void)
         return false;
     }
 
-    if (!gs_custom_init_image_deps()) {
+    char *convert_effect_path = obs_module_file("effects/pipe-convert.effect");
+    const bool effects_loaded = gs_custom_init_effects(convert_effect_path);
+    bfree(convert_effect_path);
+
+    if (!effects_loaded) {
+        return false;
+    }
+
+    if (!decode_pool_init()) {
         return false;
     }
 
     obs_register_source(&pipe_source_info);
+    obs_register_source(&pipe_source_async_info);
+    obs_register_source(&pipe_output_filter_info);
 
     obs_log(LOG_INFO, "plugin loaded successfully (version %s)", PLUGIN_VERSION);
     return true;
@@ -404,7 +608,10 @@ void obs_module_unload(void)
 {
     TRACE("obs_module_unload()");
 
+    decode_pool_free();
     ecal_finalize();
+    pixel_pool_trim();
+    gs_custom_free_effects();
     gs_custom_free_image_deps();
 
     obs_log(LOG_INFO, "plugin unloaded");
@@ -0,0 +1,376 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "stripe-codec.h"
+#include "decode-pool.h"
+#include "pipe-frame.h"
+
+#include <util/threading.h>
+
+#include <string.h>
+
+// ========================================================================== //
+// Stripes - same operations as image-decoder-qoi.c, minus header and
+// padding, and without the RGBA to BGRA swap.
+// ========================================================================== //
+
+#define STRIPE_OP_INDEX     0x00
+#define STRIPE_OP_DIFF      0x40
+#define STRIPE_OP_LUMA      0x80
+#define STRIPE_OP_RUN       0xc0
+#define STRIPE_OP_RGB       0xfe
+#define STRIPE_OP_RGBA      0xff
+#define STRIPE_MASK_2       0xc0
+
+#define STRIPE_MAX_RUN      62
+
+// Worst case per pixel, a full RGBA operation.
+#define STRIPE_MAX_PIXEL_SIZE 5
+
+union stripe_px {
+    uint8_t                     c[4];
+    uint32_t                    v;
+};
+
+static inline size_t stripe_hash(union stripe_px px)
+{
+    return (px.c[0] * 3 + px.c[1] * 5 + px.c[2] * 7 + px.c[3] * 11) % 64;
+}
+
+static size_t stripe_encode(
+    uint8_t         *dst,
+    const uint8_t   *src,
+    uint32_t        width,
+    uint32_t        rows,
+    uint32_t        stride
+) {
+    union stripe_px index[64];
+    union stripe_px prev = {{0, 0, 0, 255}};
+    size_t          p    = 0;
+    uint32_t        run  = 0;
+
+    memset(index, 0, sizeof(index));
+
+    for (uint32_t y = 0; y < rows; y++) {
+        const uint8_t *row = src + (size_t)y * stride;
+
+        for (uint32_t x = 0; x < width; x++) {
+            union stripe_px px;
+            memcpy(&px, row + (size_t)x * 4, sizeof(px));
+
+            if (px.v == prev.v) {
+                if (++run == STRIPE_MAX_RUN) {
+                    dst[p++] = (uint8_t)(STRIPE_OP_RUN | (run - 1));
+                    run      = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                dst[p++] = (uint8_t)(STRIPE_OP_RUN | (run - 1));
+                run      = 0;
+            }
+
+            const size_t hash = stripe_hash(px);
+
+            if (index[hash].v == px.v) {
+                dst[p++] = (uint8_t)(STRIPE_OP_INDEX | hash);
+            } else if (px.c[3] == prev.c[3]) {
+                const int8_t vr   = (int8_t)(px.c[0] - prev.c[0]);
+                const int8_t vg   = (int8_t)(px.c[1] - prev.c[1]);
+                const int8_t vb   = (int8_t)(px.c[2] - prev.c[2]);
+                const int8_t vg_r = (int8_t)(vr - vg);
+                const int8_t vg_b = (int8_t)(vb - vg);
+
+                index[hash] = px;
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    dst[p++] = (uint8_t)(STRIPE_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                    dst[p++] = (uint8_t)(STRIPE_OP_LUMA | (vg + 32));
+                    dst[p++] = (uint8_t)((vg_r + 8) << 4 | (vg_b + 8));
+                } else {
+                    dst[p++] = STRIPE_OP_RGB;
+                    memcpy(dst + p, px.c, 3);
+                    p += 3;
+                }
+            } else {
+                index[hash] = px;
+                dst[p++]    = STRIPE_OP_RGBA;
+                memcpy(dst + p, px.c, 4);
+                p += 4;
+            }
+
+            prev = px;
+        }
+    }
+
+    if (run > 0) {
+        dst[p++] = (uint8_t)(STRIPE_OP_RUN | (run - 1));
+    }
+
+    return p;
+}
+
+// Strict unlike the QOI decoder: the stripe must end exactly on its last
+// pixel, anything else means the table or the data is off.
+static bool stripe_decode(uint8_t *dst, const uint8_t *src, size_t size, size_t pixels)
+{
+    union stripe_px index[64];
+    union stripe_px px  = {{0, 0, 0, 255}};
+    size_t          p   = 0;
+    uint32_t        run = 0;
+
+    memset(index, 0, sizeof(index));
+
+    for (size_t i = 0; i < pixels; i++) {
+        if (run > 0) {
+            run--;
+        } else {
+            if (p >= size) {
+                return false;
+            }
+
+            const uint8_t b1 = src[p++];
+
+            if (b1 == STRIPE_OP_RGB) {
+                if (p + 3 > size) {
+                    return false;
+                }
+                memcpy(px.c, src + p, 3);
+                p += 3;
+            } else if (b1 == STRIPE_OP_RGBA) {
+                if (p + 4 > size) {
+                    return false;
+                }
+                memcpy(px.c, src + p, 4);
+                p += 4;
+            } else if ((b1 & STRIPE_MASK_2) == STRIPE_OP_INDEX) {
+                px = index[b1];
+            } else if ((b1 & STRIPE_MASK_2) == STRIPE_OP_DIFF) {
+                px.c[0] += ((b1 >> 4) & 0x03) - 2;
+                px.c[1] += ((b1 >> 2) & 0x03) - 2;
+                px.c[2] += ( b1       & 0x03) - 2;
+            } else if ((b1 & STRIPE_MASK_2) == STRIPE_OP_LUMA) {
+                if (p + 1 > size) {
+                    return false;
+                }
+                const uint8_t   b2 = src[p++];
+                const int       vg = (b1 & 0x3f) - 32;
+                px.c[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+                px.c[1] += vg;
+                px.c[2] += vg - 8 +  (b2       & 0x0f);
+            } else {
+                run = b1 & 0x3f;
+            }
+
+            index[stripe_hash(px)] = px;
+        }
+
+        memcpy(dst + i * 4, &px, sizeof(px));
+    }
+
+    return run == 0 && p == size;
+}
+
+// ========================================================================== //
+// Frames
+// ========================================================================== //
+struct stripe_codec_job {
+    uint8_t                     *dst;
+    const uint8_t               *src;
+    uint32_t                    width;
+    uint32_t                    height;
+    uint32_t                    stride;
+    uint32_t                    rows;
+
+    // Encoding: room per stripe. Decoding: where each stripe starts.
+    size_t                      stripe_bound;
+    size_t                      offsets[OBS_PIPE_MAX_STRIPES];
+    uint32_t                    sizes[OBS_PIPE_MAX_STRIPES];
+
+    pixel_convert_fn            convert;
+    volatile bool               failed;
+};
+
+static inline size_t stripe_codec_table_size(uint32_t stripe_count)
+{
+    return sizeof(uint32_t) * (1 + (size_t)stripe_count);
+}
+
+// Rows of stripe `index`, zero for stripes past the end of the frame.
+static inline uint32_t stripe_codec_rows(const struct stripe_codec_job *job, size_t index)
+{
+    const uint64_t first = (uint64_t)index * job->rows;
+    if (first >= job->height) {
+        return 0;
+    }
+    return job->height - first < job->rows ? (uint32_t)(job->height - first) : job->rows;
+}
+
+static void stripe_codec_encode_task(void *param, size_t index)
+{
+    struct stripe_codec_job *job  = param;
+    const uint32_t          rows = stripe_codec_rows(job, index);
+
+    job->sizes[index] = rows == 0 ? 0 : (uint32_t)stripe_encode(
+        job->dst + job->offsets[index],
+        job->src + index * job->rows * (size_t)job->stride,
+        job->width,
+        rows,
+        job->stride
+    );
+}
+
+static void stripe_codec_decode_task(void *param, size_t index)
+{
+    struct stripe_codec_job *job    = param;
+    const size_t            pixels  = (size_t)stripe_codec_rows(job, index) * job->width;
+    uint8_t                 *dst    = job->dst + index * job->rows * (size_t)job->width * 4;
+
+    if (pixels == 0) {
+        if (job->sizes[index] != 0) {
+            os_atomic_set_bool(&job->failed, true);
+        }
+        return;
+    }
+
+    if (!stripe_decode(dst, job->src + job->offsets[index], job->sizes[index], pixels)) {
+        os_atomic_set_bool(&job->failed, true);
+        return;
+    }
+
+    if (job->convert) {
+        job->convert(dst, dst, pixels);
+    }
+}
+
+size_t stripe_codec_bound(uint32_t width, uint32_t height, uint32_t stripe_count)
+{
+    const size_t rows = obs_pipe_stripe_rows(height, stripe_count);
+    return stripe_codec_table_size(stripe_count) + stripe_count * rows * width * STRIPE_MAX_PIXEL_SIZE;
+}
+
+size_t stripe_codec_encode(
+    uint8_t         *dst,
+    const uint8_t   *src,
+    uint32_t        width,
+    uint32_t        height,
+    uint32_t        stride,
+    uint32_t        stripe_count
+) {
+    struct stripe_codec_job job;
+    job.dst          = dst;
+    job.src          = src;
+    job.width        = width;
+    job.height       = height;
+    job.stride       = stride;
+    job.rows         = obs_pipe_stripe_rows(height, stripe_count);
+    job.stripe_bound = (size_t)job.rows * width * STRIPE_MAX_PIXEL_SIZE;
+    job.convert      = NULL;
+    job.failed       = false;
+
+    // Every stripe gets its worst case room, then they are moved together.
+    const size_t table_size = stripe_codec_table_size(stripe_count);
+    for (uint32_t i = 0; i < stripe_count; i++) {
+        job.offsets[i] = table_size + i * job.stripe_bound;
+    }
+
+    decode_pool_run(stripe_codec_encode_task, &job, stripe_count);
+
+    size_t size = table_size;
+    for (uint32_t i = 0; i < stripe_count; i++) {
+        memmove(dst + size, dst + job.offsets[i], job.sizes[i]);
+        size += job.sizes[i];
+    }
+
+    memcpy(dst, &stripe_count, sizeof(stripe_count));
+    memcpy(dst + sizeof(stripe_count), job.sizes, sizeof(uint32_t) * stripe_count);
+    return size;
+}
+
+bool stripe_codec_validate(const uint8_t *payload, size_t size, uint32_t width, uint32_t height)
+{
+    uint32_t stripe_count = 0;
+
+    if (width == 0 || height == 0 || size < sizeof(stripe_count)) {
+        return false;
+    }
+
+    memcpy(&stripe_count, payload, sizeof(stripe_count));
+    if (stripe_count == 0 || stripe_count > OBS_PIPE_MAX_STRIPES) {
+        return false;
+    }
+
+    const size_t table_size = stripe_codec_table_size(stripe_count);
+    if (size < table_size) {
+        return false;
+    }
+
+    uint64_t total = table_size;
+    for (uint32_t i = 0; i < stripe_count; i++) {
+        uint32_t stripe_size;
+        memcpy(&stripe_size, payload + sizeof(stripe_count) * (1 + i), sizeof(stripe_size));
+        total += stripe_size;
+    }
+
+    // One run byte covers at most 62 pixels, a bigger frame is a lie that
+    // would only make the receiver allocate for it.
+    return total <= size
+        && (uint64_t)width * height <= (total - table_size) * STRIPE_MAX_RUN
+        ;
+}
+
+bool stripe_codec_decode(
+    uint8_t             *dst,
+    const uint8_t       *payload,
+    size_t              size,
+    uint32_t            width,
+    uint32_t            height,
+    pixel_convert_fn    convert
+) {
+    if (!stripe_codec_validate(payload, size, width, height)) {
+        return false;
+    }
+
+    uint32_t stripe_count;
+    memcpy(&stripe_count, payload, sizeof(stripe_count));
+
+    struct stripe_codec_job job;
+    job.dst          = dst;
+    job.src          = payload;
+    job.width        = width;
+    job.height       = height;
+    job.stride       = width * 4;
+    job.rows         = obs_pipe_stripe_rows(height, stripe_count);
+    job.stripe_bound = 0;
+    job.convert      = convert;
+    job.failed       = false;
+
+    memcpy(job.sizes, payload + sizeof(stripe_count), sizeof(uint32_t) * stripe_count);
+
+    size_t offset = stripe_codec_table_size(stripe_count);
+    for (uint32_t i = 0; i < stripe_count; i++) {
+        job.offsets[i] = offset;
+        offset        += job.sizes[i];
+    }
+
+    decode_pool_run(stripe_codec_decode_task, &job, stripe_count);
+
+    return !os_atomic_load_bool(&job.failed);
+}
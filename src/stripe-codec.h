@@ -0,0 +1,74 @@
+/*
+*   obs-pipe-source
+*   Copyright (C) 2023 nullsrv
+*
+*   This program is free software; you can redistribute it and/or modify
+*   it under the terms of the GNU General Public License as published by
+*   the Free Software Foundation; either version 2 of the License, or
+*   (at your option) any later version.
+*
+*   This program is distributed in the hope that it will be useful,
+*   but WITHOUT ANY WARRANTY; without even the implied warranty of
+*   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*   GNU General Public License for more details.
+*
+*   You should have received a copy of the GNU General Public License along
+*   with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+#include "pixel-convert.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ========================================================================== //
+// Stripe codec
+//
+// Lossless coding of 32-bit frames for OBS_PIPE_FORMAT_QOI_STRIPES. Across
+// hosts the network is slower than any copy, so it is worth spending CPU on
+// the frame as long as it scales: stripes are independent and both sides
+// spread them over the decode pool. The QOI operations are cheap enough to
+// keep up with 1080p60 on a few cores and need no extra dependency.
+// ========================================================================== //
+
+// Stripes per frame used by the encoders in this plugin.
+#define STRIPE_CODEC_STRIPES 16
+
+// Payload size that always fits an encoded frame.
+size_t stripe_codec_bound(uint32_t width, uint32_t height, uint32_t stripe_count);
+
+// Encodes `height` rows of `width` 4-byte pixels, `stride` bytes apart, into
+// `dst`, which holds at least stripe_codec_bound() bytes. Returns the
+// payload size.
+size_t stripe_codec_encode(
+    uint8_t         *dst,
+    const uint8_t   *src,
+    uint32_t        width,
+    uint32_t        height,
+    uint32_t        stride,
+    uint32_t        stripe_count
+);
+
+// Checks the stripe table of a payload against the frame it claims to hold.
+bool stripe_codec_validate(const uint8_t *payload, size_t size, uint32_t width, uint32_t height);
+
+// Decodes a payload into tightly packed rows. `convert` (may be NULL) runs
+// over each stripe in place right after it is decoded, while it is still in
+// cache. Returns false if any stripe is corrupt.
+bool stripe_codec_decode(
+    uint8_t             *dst,
+    const uint8_t       *payload,
+    size_t              size,
+    uint32_t            width,
+    uint32_t            height,
+    pixel_convert_fn    convert
+);
+
+#ifdef __cplusplus
+}
+#endif